@@ -1,19 +1,444 @@
 #include "api.h"
 #include "main.h"
+#include "common/codec.h"
 #include "common/constants.h"
+#include "common/io.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int sv_fd;
 int fd_req;
 int fd_resp;
 int session_id;
+char session_features;  // Features accepted by the server for this connection
+
+#define GRID_CACHE_SIZE 8
+#define EVENT_HANDLE_COUNT 16  // Handles kept per session, for the events it created or opened last
+#define PENDING_BUCKETS 64
+
+// Last grid received for an event, kept to apply SHOW_SINCE deltas to
+struct CachedGrid {
+  unsigned int event_id;
+  unsigned int version;  // 0 if the slot holds no grid
+  size_t rows;
+  size_t cols;
+  unsigned int* seats;
+  size_t in_flight;  // SHOWs waiting for a response, the slot can't be reused until they are done
+};
+
+// Logical session multiplexed over the connection
+struct Session {
+  int id;
+  pthread_mutex_t lock;  // Protects the fields below, and keeps the requests of the session in order
+  struct CachedGrid grid_cache[GRID_CACHE_SIZE];
+  size_t next_cache_victim;
+  struct EventRef event_handles[EVENT_HANDLE_COUNT];  // Generation 0 if the slot holds no handle
+  size_t next_handle_victim;
+  struct EmsHandle* issued_head;  // Requests not waited for yet, oldest first
+  struct EmsHandle* issued_tail;
+};
+
+// Request sent to the server, until its response is consumed by ems_wait
+struct EmsHandle {
+  unsigned int request_id;
+  char op;
+  struct Session* session;
+  int out_fd;               // Where SHOW and LIST print their results
+  unsigned int event_id;    // Event printed by SHOW, or created or opened
+  struct CachedGrid* grid;  // Cache slot pinned by SHOW, NULL if the grid is not cached
+
+  struct EmsEventStats* stats;  // Filled in by STATS
+  char with_rows;               // Whether STATS asked for the rows
+  struct SeatRange* reserved;   // Filled in by RESERVE_BEST
+  struct EmsReservation* reservation;  // Filled in by GET_RESERVATION
+  struct EmsListCursor* cursor;        // Moved past the page by LIST_RANGE
+  int* results;                        // Filled in by SHOW_MANY, NULL if the caller doesn't want them
+  size_t num_results;
+
+  // Filled in by the receiver thread, under recv_mutex
+  int received;   // Whether the response arrived, or the connection was lost
+  char* payload;  // NULL if the connection was lost before the response arrived
+  size_t size;
+
+  int output_failed;  // Whether streamed RUN_JOBS or LIST output could not be written, set by the receiver thread
+
+  int finished;  // Whether the response was already processed
+  int result;    // 0 if the request succeeded, 1 otherwise, once finished
+
+  struct EmsHandle* next_pending;  // Next handle in the same bucket of the pending table
+  struct EmsHandle* next_issued;   // Next handle issued by the same session
+};
+
+// Callback of a subscription, found by the id of its SUBSCRIBE request
+struct Subscriber {
+  unsigned int request_id;
+  ems_notify_callback callback;
+  void* arg;
+  struct Subscriber* next;
+};
+
+static struct Session main_session = {.lock = PTHREAD_MUTEX_INITIALIZER};  // Used by threads without their own
+static _Thread_local struct Session* thread_session = NULL;                // Opened by ems_session_open
+static int next_session_id = 1;
+
+static pthread_mutex_t send_mutex = PTHREAD_MUTEX_INITIALIZER;  // Serializes the frames written on fd_req
+static pthread_mutex_t recv_mutex = PTHREAD_MUTEX_INITIALIZER;  // Protects the fields below
+static pthread_cond_t recv_cond = PTHREAD_COND_INITIALIZER;
+static struct EmsHandle* pending[PENDING_BUCKETS];  // Requests waiting for a response, by request id
+static unsigned int next_request_id = 1;
+static int connection_lost = 0;  // Whether the receiver thread stopped reading fd_resp
+static struct Subscriber* subscribers = NULL;  // Every subscription made on the connection
+static pthread_t receiver;
+
+/// Gets the session used by the calling thread.
+/// @return The session opened by this thread, or the main session if it has none.
+static struct Session* current_session(void) { return thread_session != NULL ? thread_session : &main_session; }
+
+/// Hands a pushed notification to the callback of its subscription.
+/// @param request_id Id of the SUBSCRIBE request the notification follows up on.
+/// @param payload Payload of the notification.
+/// @param size Size of the payload.
+static void deliver_notification(unsigned int request_id, const char* payload, size_t size) {
+  pthread_mutex_lock(&recv_mutex);
+  struct Subscriber* subscriber = subscribers;
+  while (subscriber != NULL && subscriber->request_id != request_id) {
+    subscriber = subscriber->next;
+  }
+  ems_notify_callback callback = subscriber != NULL ? subscriber->callback : NULL;
+  void* arg = subscriber != NULL ? subscriber->arg : NULL;
+  pthread_mutex_unlock(&recv_mutex);
+
+  if (callback == NULL) {
+    fprintf(stderr, "Dropped a notification for unknown subscription %u.\n", request_id);
+    return;
+  }
+
+  struct Reader reader = {payload, size, 0};
+  struct EmsNotification notification;
+  char kind;
+  if (reader_read(&reader, &notification.event_id, sizeof(unsigned int)) != 0 ||
+      reader_read(&reader, &notification.version, sizeof(unsigned int)) != 0 ||
+      reader_read(&reader, &kind, sizeof(char)) != 0 ||
+      reader_read(&reader, &notification.num_changes, sizeof(size_t)) != 0 ||
+      notification.num_changes > (size - reader.pos) / (2 * sizeof(unsigned int))) {
+    fprintf(stderr, "Failed to read a notification sent by server.\n");
+    return;
+  }
+
+  // The pairs are copied out, as they are not aligned within the frame
+  size_t num_values = 2 * (notification.num_changes > 0 ? notification.num_changes : 1);
+  unsigned int* changes = malloc(sizeof(unsigned int) * num_values);
+  if (changes == NULL) {
+    fprintf(stderr, "Failed to allocate memory for a notification.\n");
+    return;
+  }
+  reader_read(&reader, changes, 2 * sizeof(unsigned int) * notification.num_changes);
+
+  notification.dropped = kind == EMS_NOTIFY_DROPPED;
+  notification.changes = changes;
+  callback(&notification, arg);
+  free(changes);
+}
+
+/// Prints a page of event ids from a LIST response.
+/// @param out_fd File descriptor to print the events to.
+/// @param reader Reader over the page, positioned at its number of ids.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+static int print_event_ids(int out_fd, struct Reader* reader) {
+  size_t num_events;
+  const char* ids;
+  if (reader_read(reader, &num_events, sizeof(size_t)) != 0 ||
+      num_events > (reader->size - reader->pos) / sizeof(unsigned int) ||
+      (ids = reader_take(reader, sizeof(unsigned int) * num_events)) == NULL) {
+    fprintf(stderr, "Failed to read the ids of the events from the response.\n");
+    return 1;
+  }
+
+  struct Writer writer;
+  writer_init(&writer, out_fd);
+  for (size_t i = 0; i < num_events; i++) {
+    unsigned int id;
+    memcpy(&id, ids + sizeof(unsigned int) * i, sizeof(unsigned int));
+    writer_str(&writer, "Event: ");
+    writer_uint(&writer, id);
+    writer_char(&writer, '\n');
+  }
+
+  if (writer_flush(&writer) != 0) {
+    fprintf(stderr, "Failed to write event in .out file.\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Reads response frames and hands each one to the request it answers, until the server closes the pipe.
+/// @return NULL.
+static void* receive_responses(void* arg) {
+  (void)arg;
+
+  while (1) {
+    char op;
+    int frame_session_id;
+    unsigned int request_id;
+    size_t size;
+    if (read_frame_header(fd_resp, &op, &frame_session_id, &request_id, &size) != 0) {
+      break;
+    }
+
+    char* payload = malloc(size > 0 ? size : 1);
+    if (payload == NULL || read_full(fd_resp, payload, size) != 0) {
+      fprintf(stderr, "Failed to read a response from the response pipe.\n");
+      free(payload);
+      break;
+    }
+
+    // Notifications answer no request, they go to their subscription instead
+    if (op == EMS_NOTIFY_CODE) {
+      deliver_notification(request_id, payload, size);
+      free(payload);
+      continue;
+    }
+
+    pthread_mutex_lock(&recv_mutex);
+    struct EmsHandle** prev = &pending[request_id % PENDING_BUCKETS];
+    while (*prev != NULL && (*prev)->request_id != request_id) {
+      prev = &(*prev)->next_pending;
+    }
+
+    if (*prev == NULL) {
+      pthread_mutex_unlock(&recv_mutex);
+      fprintf(stderr, "Dropped a response to unknown request %u of session %d.\n", request_id, frame_session_id);
+      free(payload);
+      continue;
+    }
+
+    struct EmsHandle* handle = *prev;
+
+    // RUN_JOBS output arrives in frames starting with a 0 byte ahead of the final one, and is written out right away
+    if (handle->op == EMS_RUN_JOBS_CODE && size > 0 && payload[0] == 0) {
+      int out_fd = handle->out_fd;
+      pthread_mutex_unlock(&recv_mutex);
+      if (write_full(out_fd, payload + 1, size - 1) != 0) {
+        fprintf(stderr, "Failed to write the job output in .out file.\n");
+        handle->output_failed = 1;
+      }
+      free(payload);
+      continue;
+    }
+
+    // So do the pages of a long LIST, printed in order since the request stays pending until the last one
+    if (handle->op == EMS_LIST_CODE && size > 0 && payload[0] == 0) {
+      struct Reader page = {payload, size, 1};
+      int out_fd = handle->out_fd;
+      pthread_mutex_unlock(&recv_mutex);
+      if (print_event_ids(out_fd, &page) != 0) {
+        handle->output_failed = 1;
+      }
+      free(payload);
+      continue;
+    }
+
+    *prev = handle->next_pending;
+    handle->payload = payload;
+    handle->size = size;
+    handle->received = 1;
+    pthread_cond_broadcast(&recv_cond);
+    pthread_mutex_unlock(&recv_mutex);
+  }
+
+  // Nothing else will arrive, so every request still waiting fails
+  pthread_mutex_lock(&recv_mutex);
+  connection_lost = 1;
+  for (size_t i = 0; i < PENDING_BUCKETS; i++) {
+    for (struct EmsHandle* handle = pending[i]; handle != NULL; handle = handle->next_pending) {
+      handle->received = 1;
+    }
+    pending[i] = NULL;
+  }
+  pthread_cond_broadcast(&recv_cond);
+  pthread_mutex_unlock(&recv_mutex);
+  return NULL;
+}
+
+/// Writes a request frame on behalf of a session.
+/// @param session Session sending the request.
+/// @param request_id Id the response will carry.
+/// @param op Op code of the request.
+/// @param request Payload of the request.
+/// @return 0 if the request was sent successfully, 1 otherwise.
+static int send_frame(struct Session* session, unsigned int request_id, char op, const struct Buffer* request) {
+  pthread_mutex_lock(&send_mutex);
+  int result = write_frame(fd_req, op, session->id, request_id, request->data, request->size);
+  pthread_mutex_unlock(&send_mutex);
+
+  if (result != 0) {
+    fprintf(stderr, "Failed to write the request on the request pipe.\n");
+  }
+  return result;
+}
+
+/// Creates the handle of a new request, so the receiver thread can hand it its response.
+/// @note The session lock must be held until the request is sent, so requests reach the server in issue order.
+/// @param session Session issuing the request.
+/// @param op Op code of the request.
+/// @return The handle, NULL on failure.
+static struct EmsHandle* register_request(struct Session* session, char op) {
+  struct EmsHandle* handle = calloc(1, sizeof(struct EmsHandle));
+  if (handle == NULL) {
+    fprintf(stderr, "Failed to allocate memory for the request.\n");
+    return NULL;
+  }
+  handle->op = op;
+  handle->session = session;
+
+  pthread_mutex_lock(&recv_mutex);
+  if (connection_lost) {
+    pthread_mutex_unlock(&recv_mutex);
+    fprintf(stderr, "The connection to the server was lost.\n");
+    free(handle);
+    return NULL;
+  }
+  // Id 0 is left for requests that are never answered
+  handle->request_id = next_request_id++;
+  if (next_request_id == 0) {
+    next_request_id = 1;
+  }
+  struct EmsHandle** bucket = &pending[handle->request_id % PENDING_BUCKETS];
+  handle->next_pending = *bucket;
+  *bucket = handle;
+  pthread_mutex_unlock(&recv_mutex);
+
+  if (session->issued_tail == NULL) {
+    session->issued_head = handle;
+  } else {
+    session->issued_tail->next_issued = handle;
+  }
+  session->issued_tail = handle;
+  return handle;
+}
+
+/// Stops waiting for the response of a request that could not be sent, so it fails once waited for.
+/// @param handle The handle of the request.
+static void abandon_request(struct EmsHandle* handle) {
+  pthread_mutex_lock(&recv_mutex);
+  struct EmsHandle** prev = &pending[handle->request_id % PENDING_BUCKETS];
+  while (*prev != NULL && *prev != handle) {
+    prev = &(*prev)->next_pending;
+  }
+  if (*prev != NULL) {
+    *prev = handle->next_pending;
+  }
+  handle->received = 1;
+  pthread_mutex_unlock(&recv_mutex);
+}
+
+/// Sends a single-frame request for a session.
+/// @note The session lock must be held.
+/// @param session Session issuing the request.
+/// @param op Op code of the request.
+/// @param request Payload of the request, freed by this function.
+/// @return The handle of the request, NULL on failure.
+static struct EmsHandle* issue(struct Session* session, char op, struct Buffer* request) {
+  struct EmsHandle* handle = register_request(session, op);
+  if (handle != NULL && send_frame(session, handle->request_id, op, request) != 0) {
+    abandon_request(handle);
+  }
+
+  buffer_free(request);
+  return handle;
+}
+
+/// Sends a single-frame request for the calling thread's session.
+/// @param op Op code of the request.
+/// @param request Payload of the request, freed by this function.
+/// @return The handle of the request, NULL on failure.
+static struct EmsHandle* issue_current(char op, struct Buffer* request) {
+  struct Session* session = current_session();
+
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* handle = issue(session, op, request);
+  pthread_mutex_unlock(&session->lock);
+  return handle;
+}
+
+/// Reads the return value at the start of a response.
+/// @param reader Reader over the payload of the response.
+/// @return The return value sent by the server, FAIL_MSG if there was none.
+static int read_return_value(struct Reader* reader) {
+  int return_value = FAIL_MSG;
+  if (reader->data == NULL || reader_read(reader, &return_value, sizeof(int)) != 0) {
+    fprintf(stderr, "Failed to read response sent by server.\n");
+    return_value = FAIL_MSG;
+  }
+  return return_value;
+}
+
+/// Gets the reference a session sends for an event, its handle if the session has one.
+/// @note The session lock must be held.
+/// @param session The session addressing the event.
+/// @param event_id Id of the event.
+/// @return Reference to the event.
+static struct EventRef get_event_ref(struct Session* session, unsigned int event_id) {
+  for (size_t i = 0; i < EVENT_HANDLE_COUNT; i++) {
+    if (session->event_handles[i].generation != 0 && session->event_handles[i].id == event_id) {
+      return session->event_handles[i];
+    }
+  }
+  return (struct EventRef){event_id, 0, 0};
+}
+
+/// Gets the reference the calling thread's session sends for an event.
+/// @param event_id Id of the event.
+/// @return Reference to the event.
+static struct EventRef current_event_ref(unsigned int event_id) {
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+  struct EventRef event = get_event_ref(session, event_id);
+  pthread_mutex_unlock(&session->lock);
+  return event;
+}
+
+/// Keeps the handle to an event sent by the server, replacing the oldest one if the session has no room left.
+/// @note The session lock must be held.
+/// @param session The session the handle was given to.
+/// @param reader Reader over the payload of the response, right at the handle.
+static void read_event_handle(struct Session* session, struct Reader* reader) {
+  struct EventRef event;
+  if (reader_read(reader, &event, sizeof(struct EventRef)) != 0 || event.generation == 0) {
+    fprintf(stderr, "Failed to read the event handle from the response.\n");
+    return;
+  }
+
+  struct EventRef* slot = NULL;
+  for (size_t i = 0; slot == NULL && i < EVENT_HANDLE_COUNT; i++) {
+    if (session->event_handles[i].generation != 0 && session->event_handles[i].id == event.id) {
+      slot = &session->event_handles[i];
+    }
+  }
+  if (slot == NULL) {
+    slot = &session->event_handles[session->next_handle_victim];
+    session->next_handle_victim = (session->next_handle_victim + 1) % EVENT_HANDLE_COUNT;
+  }
+  *slot = event;
+}
+
+/// Frees the grids cached by a session.
+/// @param session The session whose cache to free.
+static void free_grid_cache(struct Session* session) {
+  for (size_t i = 0; i < GRID_CACHE_SIZE; i++) {
+    free(session->grid_cache[i].seats);
+    session->grid_cache[i].seats = NULL;
+    session->grid_cache[i].version = 0;
+  }
+}
 
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
   unlink(req_pipe_path);
@@ -46,6 +471,11 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
     fprintf(stderr, "Failed to write the response pipe path on the server pipe.\n");
     return 1;
   }
+  char features = EMS_FEATURE_SHOW_RLE;
+  if (write(sv_fd, &features, sizeof(char)) == -1) {
+    fprintf(stderr, "Failed to write the requested features on the server pipe.\n");
+    return 1;
+  }
 
   fprintf(stderr, "Opening request pipe...\n");
   fd_req = open(req_pipe_path, O_WRONLY);
@@ -68,227 +498,1238 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
     fprintf(stderr, "Failed to read this client session id from the server pipe.\n");
     return 1;
   }
+  if (read(fd_resp, &session_features, sizeof(char)) == -1) {
+    fprintf(stderr, "Failed to read the accepted features from the response pipe.\n");
+    return 1;
+  }
+
+  main_session.id = 0;
+  // From here on, responses are read by the receiver thread
+  if (pthread_create(&receiver, NULL, &receive_responses, NULL) != 0) {
+    fprintf(stderr, "Failed to create the receiver thread.\n");
+    return 1;
+  }
+  return 0;
+}
+
+int ems_session_open(void) {
+  if (thread_session != NULL) {
+    fprintf(stderr, "This thread already has a session open.\n");
+    return 1;
+  }
+
+  struct Session* session = calloc(1, sizeof(struct Session));
+  if (session == NULL) {
+    fprintf(stderr, "Failed to allocate memory for the session.\n");
+    return 1;
+  }
+  if (pthread_mutex_init(&session->lock, NULL) != 0) {
+    fprintf(stderr, "Failed to initialize the lock of the session.\n");
+    free(session);
+    return 1;
+  }
 
+  // Ids only need to be unique within the connection, the server creates the session on its first request
+  pthread_mutex_lock(&send_mutex);
+  session->id = next_session_id++;
+  pthread_mutex_unlock(&send_mutex);
+
+  thread_session = session;
   return 0;
 }
 
+int ems_session_close(void) {
+  struct Session* session = thread_session;
+  if (session == NULL) {
+    fprintf(stderr, "This thread has no session open.\n");
+    return 1;
+  }
+
+  ems_wait_all();
+  struct Buffer request = {NULL, 0, 0};
+  int result = send_frame(session, 0, EMS_QUIT_CODE, &request);
+
+  thread_session = NULL;
+  free_grid_cache(session);
+  pthread_mutex_destroy(&session->lock);
+  free(session);
+  return result;
+}
+
 int ems_quit(void) {
   fprintf(stderr, "We ended here!");
-  char OP_CODE = EMS_QUIT_CODE;
-  if (write(fd_req, &OP_CODE, sizeof(char)) == -1) {
-    fprintf(stderr, "Failed to write the OP_CODE on the request pipe.\n");
+  ems_wait_all();
+  struct Buffer request = {NULL, 0, 0};
+  if (send_frame(&main_session, 0, EMS_QUIT_CODE, &request) != 0) {
     return 1;
   }
 
+  // The server closes the response pipe once it is done with this connection, which stops the receiver
   close(fd_req);
+  pthread_join(receiver, NULL);
   close(fd_resp);
-  return 1; 
+
+  free_grid_cache(&main_session);
+  while (subscribers != NULL) {
+    struct Subscriber* next = subscribers->next;
+    free(subscribers);
+    subscribers = next;
+  }
+  return 1;
+}
+
+struct EmsHandle* ems_create_async(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &event_id, sizeof(unsigned int)) != 0 ||
+      buffer_append(&request, &num_rows, sizeof(size_t)) != 0 ||
+      buffer_append(&request, &num_cols, sizeof(size_t)) != 0) {
+    fprintf(stderr, "Failed to build the create request.\n");
+    buffer_free(&request);
+    return NULL;
+  }
+
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* handle = issue(session, EMS_CREATE_CODE, &request);
+  if (handle != NULL) {
+    handle->event_id = event_id;
+  }
+  pthread_mutex_unlock(&session->lock);
+  return handle;
 }
 
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  return ems_wait(ems_create_async(event_id, num_rows, num_cols));
+}
 
-  // Request pipe
-  char OP_CODE = EMS_CREATE_CODE;
-  if (write(fd_req, &OP_CODE, sizeof(char)) == -1) {
-    fprintf(stderr, "Failed to write the OP_CODE on the request pipe.\n");
-    return 1;
+struct EmsHandle* ems_create_many_async(size_t num_events, const unsigned int* event_ids, size_t num_rows,
+                                        size_t num_cols) {
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &num_events, sizeof(size_t)) != 0 ||
+      buffer_append(&request, &num_rows, sizeof(size_t)) != 0 ||
+      buffer_append(&request, &num_cols, sizeof(size_t)) != 0 ||
+      buffer_append(&request, event_ids, sizeof(unsigned int) * num_events) != 0) {
+    fprintf(stderr, "Failed to build the create request.\n");
+    buffer_free(&request);
+    return NULL;
   }
-  if (write(fd_req, &event_id, sizeof(unsigned int)) == -1) {
-    fprintf(stderr, "Failed to write the event ID on the request pipe.\n");
+
+  return issue_current(EMS_CREATE_MANY_CODE, &request);
+}
+
+int ems_create_many(size_t num_events, const unsigned int* event_ids, size_t num_rows, size_t num_cols) {
+  return ems_wait(ems_create_many_async(num_events, event_ids, num_rows, num_cols));
+}
+
+int ems_create_range(unsigned int first_id, unsigned int last_id, size_t num_rows, size_t num_cols) {
+  if (last_id < first_id) {
+    fprintf(stderr, "Invalid range of events.\n");
     return 1;
   }
-  if (write(fd_req, &num_rows, sizeof(size_t)) == -1) {
-    fprintf(stderr, "Failed to write the number of rows on the request pipe.\n");
+
+  size_t num_events = (size_t)(last_id - first_id) + 1;
+  unsigned int* event_ids = malloc(sizeof(unsigned int) * num_events);
+  if (event_ids == NULL) {
+    fprintf(stderr, "Failed to allocate memory for the event ids.\n");
     return 1;
   }
-  if (write(fd_req, &num_cols, sizeof(size_t)) == -1) {
-    fprintf(stderr, "Failed to write the number of columns on the request pipe.\n");
-    return 1;
+
+  for (size_t i = 0; i < num_events; i++) {
+    event_ids[i] = first_id + (unsigned int)i;
   }
+  int result = ems_create_many(num_events, event_ids, num_rows, num_cols);
+  free(event_ids);
+  return result;
+}
 
-  // Response pipe
-  int return_value;
-  if (read(fd_resp, &return_value, sizeof(int)) == -1) {
-    fprintf(stderr, "Failed to read response sent by server.\n");
-    return 1;
+struct EmsHandle* ems_create_template_async(unsigned int template_id, size_t num_rows, size_t num_cols,
+                                            size_t num_blocked, const size_t* xs, const size_t* ys) {
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &template_id, sizeof(unsigned int)) != 0 ||
+      buffer_append(&request, &num_rows, sizeof(size_t)) != 0 ||
+      buffer_append(&request, &num_cols, sizeof(size_t)) != 0 ||
+      buffer_append(&request, &num_blocked, sizeof(size_t)) != 0 ||
+      (num_blocked > 0 && (buffer_append(&request, xs, sizeof(size_t) * num_blocked) != 0 ||
+                           buffer_append(&request, ys, sizeof(size_t) * num_blocked) != 0))) {
+    fprintf(stderr, "Failed to build the create template request.\n");
+    buffer_free(&request);
+    return NULL;
   }
 
-  if (return_value == SUCCESS_MSG) {
-    // done
+  return issue_current(EMS_CREATE_TEMPLATE_CODE, &request);
+}
+
+int ems_create_template(unsigned int template_id, size_t num_rows, size_t num_cols, size_t num_blocked,
+                        const size_t* xs, const size_t* ys) {
+  return ems_wait(ems_create_template_async(template_id, num_rows, num_cols, num_blocked, xs, ys));
+}
+
+struct EmsHandle* ems_create_from_template_async(unsigned int template_id, size_t num_events,
+                                                 const unsigned int* event_ids) {
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &template_id, sizeof(unsigned int)) != 0 ||
+      buffer_append(&request, &num_events, sizeof(size_t)) != 0 ||
+      buffer_append(&request, event_ids, sizeof(unsigned int) * num_events) != 0) {
+    fprintf(stderr, "Failed to build the create request.\n");
+    buffer_free(&request);
+    return NULL;
   }
-  else {
-    fprintf(stderr, "Failed to create an event on client %d, with error value %d.\n", session_id, return_value);
+
+  return issue_current(EMS_CREATE_FROM_TEMPLATE_CODE, &request);
+}
+
+int ems_create_from_template(unsigned int template_id, size_t num_events, const unsigned int* event_ids) {
+  return ems_wait(ems_create_from_template_async(template_id, num_events, event_ids));
+}
+
+struct EmsHandle* ems_import_async(const char* name) {
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, name, strlen(name)) != 0) {
+    fprintf(stderr, "Failed to build the import request.\n");
+    buffer_free(&request);
+    return NULL;
+  }
+
+  return issue_current(EMS_IMPORT_CODE, &request);
+}
+
+int ems_import(const char* name) { return ems_wait(ems_import_async(name)); }
+
+int ems_open_event(unsigned int event_id) {
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &event_id, sizeof(unsigned int)) != 0) {
+    fprintf(stderr, "Failed to build the open event request.\n");
+    buffer_free(&request);
     return 1;
   }
- 
-  return 0;
+
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* handle = issue(session, EMS_OPEN_EVENT_CODE, &request);
+  if (handle != NULL) {
+    handle->event_id = event_id;
+  }
+  pthread_mutex_unlock(&session->lock);
+  return ems_wait(handle);
+}
+
+struct EmsHandle* ems_reserve_async(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  struct EventRef event = current_event_ref(event_id);
+  struct Buffer request = {NULL, 0, 0};
+  unsigned char* encoded = NULL;
+  if (buffer_append(&request, &event, sizeof(struct EventRef)) != 0 ||
+      buffer_append(&request, &num_seats, sizeof(size_t)) != 0 ||
+      (encoded = buffer_extend(&request, sizeof(size_t) + VARINT_MAX_SIZE * num_seats)) == NULL) {
+    fprintf(stderr, "Failed to build the reserve request.\n");
+    buffer_free(&request);
+    return NULL;
+  }
+
+  // The encoded size goes right before the encoded seats, the unused room is trimmed off
+  size_t encoded_size = seats_encode(num_seats, xs, ys, encoded + sizeof(size_t));
+  if (encoded_size == SIZE_MAX) {
+    fprintf(stderr, "Failed to encode the seats of the reserve request.\n");
+    buffer_free(&request);
+    return NULL;
+  }
+  memcpy(encoded, &encoded_size, sizeof(size_t));
+  request.size = request.size - VARINT_MAX_SIZE * num_seats + encoded_size;
+
+  return issue_current(EMS_RESERVE_CODE, &request);
 }
 
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  return ems_wait(ems_reserve_async(event_id, num_seats, xs, ys));
+}
 
-  char OP_CODE = EMS_RESERVE_CODE;
-  if (write(fd_req, &OP_CODE, sizeof(char)) == -1) {
-    fprintf(stderr, "Failed to write the OP_CODE on the request pipe.\n");
-    return 1;
+struct EmsHandle* ems_reserve_ranges_async(unsigned int event_id, size_t num_ranges, const struct SeatRange* ranges) {
+  int single_seats = 1;
+  for (size_t i = 0; i < num_ranges; i++) {
+    if (ranges[i].x1 != ranges[i].x2 || ranges[i].y1 != ranges[i].y2) {
+      single_seats = 0;
+      break;
+    }
   }
-  if (write(fd_req, &event_id, sizeof(unsigned int)) == -1) {
-    fprintf(stderr, "Failed to write the event ID on the request pipe.\n");
-    return 1;
+
+  if (single_seats) {
+    size_t* xs = malloc(sizeof(size_t) * (num_ranges > 0 ? num_ranges : 1));
+    size_t* ys = malloc(sizeof(size_t) * (num_ranges > 0 ? num_ranges : 1));
+    if (xs == NULL || ys == NULL) {
+      fprintf(stderr, "Failed to allocate memory for the seats.\n");
+      free(xs);
+      free(ys);
+      return NULL;
+    }
+
+    for (size_t i = 0; i < num_ranges; i++) {
+      xs[i] = ranges[i].x1;
+      ys[i] = ranges[i].y1;
+    }
+
+    struct EmsHandle* handle = ems_reserve_async(event_id, num_ranges, xs, ys);
+    free(xs);
+    free(ys);
+    return handle;
   }
-  if (write(fd_req, &num_seats, sizeof(size_t)) == -1) {
-    fprintf(stderr, "Failed to write the number of seats on the request pipe.\n");
-    return 1;
+
+  // Ranges go out in frames of up to EMS_RANGE_CHUNK_SIZE sharing one request id, only the last one is answered.
+  // The session stays locked so no other request of the session lands between the chunks.
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* handle = register_request(session, EMS_RESERVE_RANGES_CODE);
+  struct EventRef event = get_event_ref(session, event_id);
+  size_t sent = 0;
+  char last = handle == NULL;
+  while (!last) {
+    size_t chunk = num_ranges - sent < EMS_RANGE_CHUNK_SIZE ? num_ranges - sent : EMS_RANGE_CHUNK_SIZE;
+    last = sent + chunk == num_ranges;
+
+    struct Buffer request = {NULL, 0, 0};
+    unsigned char* encoded = NULL;
+    if (buffer_append(&request, &event, sizeof(struct EventRef)) != 0 ||
+        buffer_append(&request, &last, sizeof(char)) != 0 || buffer_append(&request, &chunk, sizeof(size_t)) != 0 ||
+        (encoded = buffer_extend(&request, sizeof(size_t) + SEAT_RANGE_MAX_SIZE * chunk)) == NULL) {
+      fprintf(stderr, "Failed to build the reserve request.\n");
+      buffer_free(&request);
+      abandon_request(handle);
+      break;
+    }
+
+    size_t encoded_size = ranges_encode(chunk, ranges + sent, encoded + sizeof(size_t));
+    memcpy(encoded, &encoded_size, sizeof(size_t));
+    request.size = request.size - SEAT_RANGE_MAX_SIZE * chunk + encoded_size;
+
+    int result = send_frame(session, handle->request_id, EMS_RESERVE_RANGES_CODE, &request);
+    buffer_free(&request);
+    if (result != 0) {
+      abandon_request(handle);
+      break;
+    }
+    sent += chunk;
   }
-  if (write(fd_req, xs, sizeof(size_t) * num_seats) == -1) {
-    fprintf(stderr, "Failed to write the xs value on the request pipe.\n");
-    return 1;
+  pthread_mutex_unlock(&session->lock);
+
+  return handle;
+}
+
+int ems_reserve_ranges(unsigned int event_id, size_t num_ranges, const struct SeatRange* ranges) {
+  return ems_wait(ems_reserve_ranges_async(event_id, num_ranges, ranges));
+}
+
+struct EmsHandle* ems_reserve_best_async(unsigned int event_id, size_t num_seats, size_t near_row,
+                                         struct SeatRange* reserved) {
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+
+  struct EventRef event = get_event_ref(session, event_id);
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &event, sizeof(struct EventRef)) != 0 ||
+      buffer_append(&request, &num_seats, sizeof(size_t)) != 0 ||
+      buffer_append(&request, &near_row, sizeof(size_t)) != 0) {
+    fprintf(stderr, "Failed to build the reserve request.\n");
+    buffer_free(&request);
+    pthread_mutex_unlock(&session->lock);
+    return NULL;
+  }
+
+  struct EmsHandle* handle = issue(session, EMS_RESERVE_BEST_CODE, &request);
+  if (handle != NULL) {
+    handle->event_id = event_id;
+    handle->reserved = reserved;
+  }
+  pthread_mutex_unlock(&session->lock);
+  return handle;
+}
+
+int ems_reserve_best(unsigned int event_id, size_t num_seats, size_t near_row, struct SeatRange* reserved) {
+  return ems_wait(ems_reserve_best_async(event_id, num_seats, near_row, reserved));
+}
+
+/// Sends a request addressing one reservation of an event.
+/// @param op Op code of the request.
+/// @param event_id Id of the event the reservation is for.
+/// @param reservation_id Id of the reservation.
+/// @param reservation Where GET_RESERVATION stores the seats, NULL for other requests.
+/// @return Handle of the request, NULL if it could not be sent.
+static struct EmsHandle* issue_reservation_request(char op, unsigned int event_id, unsigned int reservation_id,
+                                                   struct EmsReservation* reservation) {
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+
+  struct EventRef event = get_event_ref(session, event_id);
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &event, sizeof(struct EventRef)) != 0 ||
+      buffer_append(&request, &reservation_id, sizeof(unsigned int)) != 0) {
+    fprintf(stderr, "Failed to build the reservation request.\n");
+    buffer_free(&request);
+    pthread_mutex_unlock(&session->lock);
+    return NULL;
+  }
+
+  struct EmsHandle* handle = issue(session, op, &request);
+  if (handle != NULL) {
+    handle->event_id = event_id;
+    handle->reservation = reservation;
+  }
+  pthread_mutex_unlock(&session->lock);
+  return handle;
+}
+
+struct EmsHandle* ems_cancel_async(unsigned int event_id, unsigned int reservation_id) {
+  return issue_reservation_request(EMS_CANCEL_CODE, event_id, reservation_id, NULL);
+}
+
+int ems_cancel(unsigned int event_id, unsigned int reservation_id) {
+  return ems_wait(ems_cancel_async(event_id, reservation_id));
+}
+
+struct EmsHandle* ems_get_reservation_async(unsigned int event_id, unsigned int reservation_id,
+                                            struct EmsReservation* reservation) {
+  return issue_reservation_request(EMS_GET_RESERVATION_CODE, event_id, reservation_id, reservation);
+}
+
+int ems_get_reservation(unsigned int event_id, unsigned int reservation_id, struct EmsReservation* reservation) {
+  return ems_wait(ems_get_reservation_async(event_id, reservation_id, reservation));
+}
+
+struct EmsHandle* ems_reserve_multi_async(size_t num_parts, const struct EmsReservePart* parts) {
+  if (num_parts == 0 || num_parts > EMS_MULTI_MAX_EVENTS) {
+    fprintf(stderr, "A reservation must span between 1 and %d events.\n", EMS_MULTI_MAX_EVENTS);
+    return NULL;
+  }
+
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &num_parts, sizeof(size_t)) != 0) {
+    fprintf(stderr, "Failed to build the reserve request.\n");
+    return NULL;
+  }
+
+  // The handles are read under the same lock the request is sent with, so they can't be replaced in between
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+  int result = 0;
+  for (size_t i = 0; result == 0 && i < num_parts; i++) {
+    size_t num_ranges = parts[i].num_ranges;
+    struct EventRef event = get_event_ref(session, parts[i].event_id);
+    unsigned char* encoded = NULL;
+    result = num_ranges == 0 || num_ranges > MAX_RESERVATION_SIZE ||
+             buffer_append(&request, &event, sizeof(struct EventRef)) != 0 ||
+             buffer_append(&request, &num_ranges, sizeof(size_t)) != 0 ||
+             (encoded = buffer_extend(&request, sizeof(size_t) + SEAT_RANGE_MAX_SIZE * num_ranges)) == NULL;
+    if (result == 0) {
+      size_t encoded_size = ranges_encode(num_ranges, parts[i].ranges, encoded + sizeof(size_t));
+      memcpy(encoded, &encoded_size, sizeof(size_t));
+      request.size = request.size - SEAT_RANGE_MAX_SIZE * num_ranges + encoded_size;
+    }
+  }
+
+  struct EmsHandle* handle = NULL;
+  if (result != 0) {
+    fprintf(stderr, "Failed to build the reserve request.\n");
+    buffer_free(&request);
+  } else {
+    handle = issue(session, EMS_RESERVE_MULTI_CODE, &request);
+  }
+  pthread_mutex_unlock(&session->lock);
+  return handle;
+}
+
+int ems_reserve_multi(size_t num_parts, const struct EmsReservePart* parts) {
+  return ems_wait(ems_reserve_multi_async(num_parts, parts));
+}
+
+struct EmsHandle* ems_run_jobs_async(int out_fd, const char* script, size_t size) {
+  // The script goes out in frames of up to EMS_JOBS_CHUNK_SIZE sharing one request id, only the last one is answered.
+  // The session stays locked so no other request of the session lands between the chunks.
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* handle = register_request(session, EMS_RUN_JOBS_CODE);
+  if (handle != NULL) {
+    handle->out_fd = out_fd;
   }
-  if (write(fd_req, ys, sizeof(size_t) * num_seats) == -1) {
-    fprintf(stderr, "Failed to write the ys value on the request pipe.\n");
+
+  size_t sent = 0;
+  char last = handle == NULL;
+  while (!last) {
+    size_t chunk = size - sent < EMS_JOBS_CHUNK_SIZE ? size - sent : EMS_JOBS_CHUNK_SIZE;
+    last = sent + chunk == size;
+
+    struct Buffer request = {NULL, 0, 0};
+    if (buffer_append(&request, &last, sizeof(char)) != 0 || buffer_append(&request, script + sent, chunk) != 0) {
+      fprintf(stderr, "Failed to build the run jobs request.\n");
+      buffer_free(&request);
+      abandon_request(handle);
+      break;
+    }
+
+    int result = send_frame(session, handle->request_id, EMS_RUN_JOBS_CODE, &request);
+    buffer_free(&request);
+    if (result != 0) {
+      abandon_request(handle);
+      break;
+    }
+    sent += chunk;
+  }
+  pthread_mutex_unlock(&session->lock);
+
+  return handle;
+}
+
+int ems_run_jobs(int out_fd, const char* script, size_t size) {
+  return ems_wait(ems_run_jobs_async(out_fd, script, size));
+}
+
+int ems_subscribe(size_t num_events, const unsigned int* event_ids, ems_notify_callback callback, void* arg) {
+  struct Subscriber* subscriber = malloc(sizeof(struct Subscriber));
+  struct Buffer request = {NULL, 0, 0};
+  if (subscriber == NULL || buffer_append(&request, &num_events, sizeof(size_t)) != 0 ||
+      buffer_append(&request, event_ids, sizeof(unsigned int) * num_events) != 0) {
+    fprintf(stderr, "Failed to build the subscribe request.\n");
+    free(subscriber);
+    buffer_free(&request);
     return 1;
   }
+  subscriber->callback = callback;
+  subscriber->arg = arg;
 
-  // Response pipe
-  int return_value;
-  if (read(fd_resp, &return_value, sizeof(int)) == -1) {
-    fprintf(stderr, "Failed to read response sent by server.\n");
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* handle = register_request(session, EMS_SUBSCRIBE_CODE);
+  if (handle != NULL) {
+    // Notifications may overtake the response, so the callback is known before the request goes out
+    pthread_mutex_lock(&recv_mutex);
+    subscriber->request_id = handle->request_id;
+    subscriber->next = subscribers;
+    subscribers = subscriber;
+    pthread_mutex_unlock(&recv_mutex);
+
+    if (send_frame(session, handle->request_id, EMS_SUBSCRIBE_CODE, &request) != 0) {
+      abandon_request(handle);
+    }
+  } else {
+    free(subscriber);
+  }
+  pthread_mutex_unlock(&session->lock);
+  buffer_free(&request);
+
+  return ems_wait(handle);
+}
+
+/// Reads a seat grid from a response, in the encoding negotiated for this connection.
+/// @param reader Reader over the payload of the response.
+/// @param seats Array to store the seats in.
+/// @param num_seats Number of seats to read.
+/// @return 0 if the seats were read successfully, 1 otherwise.
+static int read_seats(struct Reader* reader, unsigned int* seats, size_t num_seats) {
+  char encoding = EMS_SHOW_ENCODING_RAW;
+  if ((session_features & EMS_FEATURE_SHOW_RLE) && reader_read(reader, &encoding, sizeof(char)) != 0) {
+    fprintf(stderr, "Failed to read the seats encoding from the response.\n");
     return 1;
   }
 
-  printf("Reponse -> %d\n", return_value);
-  if (return_value == SUCCESS_MSG) {
-    // done
+  if (encoding != EMS_SHOW_ENCODING_RLE) {
+    if (reader_read(reader, seats, sizeof(unsigned int) * num_seats) != 0) {
+      fprintf(stderr, "Failed to read the seats information from the response.\n");
+      return 1;
+    }
+    return 0;
   }
-  else {
-    fprintf(stderr, "Failed to reserve a seat on an event on client %d.\n", session_id);
+
+  size_t encoded_size;
+  const unsigned char* encoded;
+  if (reader_read(reader, &encoded_size, sizeof(size_t)) != 0 ||
+      (encoded = reader_take(reader, encoded_size)) == NULL ||
+      rle_decode(encoded, encoded_size, seats, num_seats) != 0) {
+    fprintf(stderr, "Failed to read the encoded seats from the response.\n");
     return 1;
   }
 
   return 0;
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  //TODO: send show request to the server (through the request pipe) and wait for the response (through the response pipe)
-  char OP_CODE = EMS_SHOW_CODE;
-  if (write(fd_req, &OP_CODE, sizeof(char)) == -1) {
-    fprintf(stderr, "Failed to write the OP_CODE on the request pipe.\n");
-    return 1;
+/// Finds the cached grid of an event, or picks a slot to cache it in.
+/// @param session Session whose cache to search.
+/// @param event_id Id of the event.
+/// @return Cache slot for the event, with version 0 if it holds no grid for it, NULL if every slot is in use.
+static struct CachedGrid* get_cached_grid(struct Session* session, unsigned int event_id) {
+  for (size_t i = 0; i < GRID_CACHE_SIZE; i++) {
+    struct CachedGrid* grid = &session->grid_cache[i];
+    if ((grid->version != 0 || grid->in_flight > 0) && grid->event_id == event_id) {
+      return grid;
+    }
   }
-  if (write(fd_req, &event_id, sizeof(unsigned int)) == -1) {
-    fprintf(stderr, "Failed to write the event ID on the request pipe.\n");
-    return 1;
+
+  // Slots still waiting for a SHOW response are skipped, that response will be applied to them
+  for (size_t i = 0; i < GRID_CACHE_SIZE; i++) {
+    struct CachedGrid* grid = &session->grid_cache[session->next_cache_victim];
+    session->next_cache_victim = (session->next_cache_victim + 1) % GRID_CACHE_SIZE;
+    if (grid->in_flight == 0) {
+      grid->event_id = event_id;
+      grid->version = 0;
+      return grid;
+    }
   }
 
-  // Response pipe
-  int return_value;
-  if (read(fd_resp, &return_value, sizeof(int)) == -1) {
-    
-    fprintf(stderr, "Failed to read response sent by server.\n");
+  return NULL;
+}
+
+/// Brings a cached grid up to date with a SHOW_SINCE response.
+/// @param grid Cache slot of the event, invalidated on failure.
+/// @param reader Reader over the payload of the response, past the return value.
+/// @return 0 if the grid was updated successfully, 1 otherwise.
+static int update_cached_grid(struct CachedGrid* grid, struct Reader* reader) {
+  unsigned int version;
+  size_t num_rows, num_cols;
+  char kind;
+  if (reader_read(reader, &version, sizeof(unsigned int)) != 0 || reader_read(reader, &num_rows, sizeof(size_t)) != 0 ||
+      reader_read(reader, &num_cols, sizeof(size_t)) != 0 || reader_read(reader, &kind, sizeof(char)) != 0) {
+    fprintf(stderr, "Failed to read the event header from the response.\n");
+    grid->version = 0;
     return 1;
   }
 
+  if (kind == EMS_SHOW_FULL) {
+    if (grid->seats == NULL || grid->rows * grid->cols != num_rows * num_cols) {
+      unsigned int* seats = realloc(grid->seats, sizeof(unsigned int) * num_rows * num_cols);
+      if (seats == NULL) {
+        fprintf(stderr, "Failed to allocate memory for the seats.\n");
+        grid->version = 0;
+        return 1;
+      }
+      grid->seats = seats;
+    }
+    grid->rows = num_rows;
+    grid->cols = num_cols;
 
-  size_t num_rows, num_cols;
-  unsigned int* seats; 
-  
-  if (return_value == SUCCESS_MSG) {
-    if (read(fd_resp, &num_rows, sizeof(size_t)) == -1) {
-      fprintf(stderr, "Failed to read the number of rows from the response pipe.\n");
+    if (read_seats(reader, grid->seats, num_rows * num_cols) != 0) {
+      grid->version = 0;
       return 1;
     }
-    if (read(fd_resp, &num_cols, sizeof(size_t)) == -1) {
-      fprintf(stderr, "Failed to read the number of cols from the response pipe.\n");
-      return 1;
+    grid->version = version;
+    return 0;
+  }
+
+  size_t num_changes;
+  const unsigned int* changes;  // Seat index and reservation id pairs
+  if (reader_read(reader, &num_changes, sizeof(size_t)) != 0 ||
+      num_changes > (reader->size - reader->pos) / (2 * sizeof(unsigned int)) ||
+      (changes = reader_take(reader, 2 * sizeof(unsigned int) * num_changes)) == NULL) {
+    fprintf(stderr, "Failed to read the seat changes from the response.\n");
+    grid->version = 0;
+    return 1;
+  }
+
+  if (grid->version == 0 || grid->rows != num_rows || grid->cols != num_cols) {
+    fprintf(stderr, "Received seat changes for a grid that is not cached.\n");
+    grid->version = 0;
+    return 1;
+  }
+
+  for (size_t i = 0; i < num_changes; i++) {
+    unsigned int change[2];
+    memcpy(change, changes + 2 * i, sizeof(change));
+    if (change[0] < num_rows * num_cols) {
+      grid->seats[change[0]] = change[1];
     }
-    seats = (unsigned int*) malloc(sizeof(unsigned int) * (num_rows * num_cols));
-    
-    if (read(fd_resp, seats, sizeof(unsigned int) * (num_rows * num_cols)) == -1) {
-      fprintf(stderr, "Failed to read the seats information from the response pipe.\n");
-      return 1;
+  }
+  grid->version = version;
+  return 0;
+}
+
+/// Prints a seat grid, one row per line.
+/// @param out_fd File descriptor to print to.
+/// @param grid The grid to print.
+/// @return 0 if the grid was printed successfully, 1 otherwise.
+static int print_grid(int out_fd, const struct CachedGrid* grid) {
+  struct Writer writer;
+  writer_init(&writer, out_fd);
+
+  const unsigned int* seat = grid->seats;
+  for (size_t i = 1; i <= grid->rows; i++) {
+    for (size_t j = 1; j <= grid->cols; j++) {
+      writer_uint(&writer, *seat++);
+      writer_char(&writer, j < grid->cols ? ' ' : '\n');
     }
+  }
 
-    fprintf(stderr, "fd -> %d.\n", out_fd);
+  if (writer_flush(&writer) != 0) {
+    fprintf(stderr, "Failed to write event in .out file.\n");
+    return 1;
   }
-  else {
+  return 0;
+}
+
+/// Applies a SHOW_SINCE response to the cached grid and prints the event.
+/// @param handle The handle of the SHOW request.
+/// @param reader Reader over the payload of the response.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+static int finish_show(struct EmsHandle* handle, struct Reader* reader) {
+  struct CachedGrid uncached = {handle->event_id, 0, 0, 0, NULL, 0};
+  struct CachedGrid* grid = handle->grid != NULL ? handle->grid : &uncached;
+  if (handle->grid != NULL) {
+    handle->grid->in_flight--;
+  }
+
+  int return_value = FAIL_MSG;
+  if (reader->data != NULL && reader_read(reader, &return_value, sizeof(int)) != 0) {
+    return_value = FAIL_MSG;
+  }
+
+  if (return_value != SUCCESS_MSG) {
     fprintf(stderr, "Failed to show an event on client %d.\n", session_id);
     return 1;
   }
 
-  char end_line = '\n';
-  char space = ' ';
-  int counter = 1;
+  int result = update_cached_grid(grid, reader);
+  if (result == 0) {
+    result = print_grid(handle->out_fd, grid);
+  }
+  free(uncached.seats);
+  return result;
+}
 
-  for (int i = 0; i < (int)( num_rows * num_cols); i++) {
-    char test = (char)(seats[i] + '0');
+/// Prints the events of a SHOW_MANY response.
+/// @param handle The handle of the SHOW_MANY request.
+/// @param reader Reader over the payload of the response.
+/// @return 0 if every event was printed successfully, 1 otherwise.
+static int finish_show_many(struct EmsHandle* handle, struct Reader* reader) {
+  for (size_t i = 0; handle->results != NULL && i < handle->num_results; i++) {
+    handle->results[i] = 1;
+  }
 
+  size_t num_events;
+  if (read_return_value(reader) != SUCCESS_MSG || reader_read(reader, &num_events, sizeof(size_t)) != 0 ||
+      num_events != handle->num_results) {
+    fprintf(stderr, "Failed to show events on client %d.\n", session_id);
+    return 1;
+  }
 
-    if(write(out_fd, &test, sizeof(test)) == -1) {
-      fprintf(stderr, "Failed to write event in .out file.\n");
+  // Grids are printed one at a time, so a single buffer holds them all in turn
+  struct CachedGrid grid = {0, 0, 0, 0, NULL, 0};
+  int result = 0;
+  for (size_t i = 0; i < num_events; i++) {
+    int return_value = read_return_value(reader);
+    if (return_value != SUCCESS_MSG) {
+      fprintf(stderr, "Failed to show an event on client %d.\n", session_id);
+      result = 1;
+      continue;
     }
 
-    if (counter == (int) num_cols) {
-      if(write(out_fd, &end_line, sizeof(end_line)) == -1) {
-        fprintf(stderr, "Failed to write event in .out file.\n");
-      }
-      counter = 1;
-    } else {
-      if(write(out_fd, &space, sizeof(space)) == -1) {
-        fprintf(stderr, "Failed to write event in .out file.\n");
+    size_t num_rows, num_cols;
+    if (reader_read(reader, &num_rows, sizeof(size_t)) != 0 || reader_read(reader, &num_cols, sizeof(size_t)) != 0) {
+      fprintf(stderr, "Failed to read the event header from the response.\n");
+      result = 1;
+      break;
+    }
+
+    if (num_rows * num_cols > grid.rows * grid.cols) {
+      unsigned int* seats = realloc(grid.seats, sizeof(unsigned int) * num_rows * num_cols);
+      if (seats == NULL) {
+        fprintf(stderr, "Failed to allocate memory for the seats.\n");
+        result = 1;
+        break;
       }
-      counter ++;
+      grid.seats = seats;
+      grid.rows = num_rows;
+      grid.cols = num_cols;
+    }
+
+    struct CachedGrid shown = {0, 0, num_rows, num_cols, grid.seats, 0};
+    if (read_seats(reader, shown.seats, num_rows * num_cols) != 0) {
+      result = 1;
+      break;
     }
+    if (print_grid(handle->out_fd, &shown) != 0) {
+      result = 1;
+      continue;
+    }
+    if (handle->results != NULL) {
+      handle->results[i] = 0;
+    }
+  }
+
+  free(grid.seats);
+  return result;
+}
+
+/// Reads the outcome of a LIST request, whose earlier pages were already printed as they arrived.
+/// @param handle The handle of the LIST request.
+/// @param reader Reader over the payload of the last page.
+/// @return 0 if every event was printed successfully, 1 otherwise.
+static int finish_list(struct EmsHandle* handle, struct Reader* reader) {
+  char last;
+  int return_value = FAIL_MSG;
+  if (reader->data == NULL || reader_read(reader, &last, sizeof(char)) != 0 ||
+      reader_read(reader, &return_value, sizeof(int)) != 0) {
+    return_value = FAIL_MSG;
+  }
+
+  if (return_value != SUCCESS_MSG) {
+    fprintf(stderr, "Failed to list the events on client %d.\n", session_id);
+    return 1;
+  }
+  return print_event_ids(handle->out_fd, reader) || handle->output_failed;
+}
+
+/// Prints a page of a LIST_RANGE response and moves the cursor of its handle past it.
+/// @param handle The handle of the LIST_RANGE request.
+/// @param reader Reader over the payload of the response.
+/// @return 0 if the page was printed successfully, 1 otherwise.
+static int finish_list_range(struct EmsHandle* handle, struct Reader* reader) {
+  struct EmsListCursor* cursor = handle->cursor;
+  char more;
+  unsigned int next_id;
+  if (read_return_value(reader) != SUCCESS_MSG || reader_read(reader, &more, sizeof(char)) != 0 ||
+      reader_read(reader, &next_id, sizeof(unsigned int)) != 0) {
+    fprintf(stderr, "Failed to list the events on client %d.\n", session_id);
+    cursor->more = 0;
+    return 1;
+  }
+
+  cursor->more = more;
+  if (more) {
+    cursor->next_id = next_id;
+  }
+  return print_event_ids(handle->out_fd, reader);
+}
+
+/// Reads the response to a STATS request into the stats of its handle.
+/// @param handle The handle of the STATS request.
+/// @param reader Reader over the payload of the response.
+/// @return 0 if the stats were read successfully, 1 otherwise.
+static int finish_stats(struct EmsHandle* handle, struct Reader* reader) {
+  struct EmsEventStats* stats = handle->stats;
+  stats->row_reserved = NULL;
+
+  if (read_return_value(reader) != SUCCESS_MSG) {
+    fprintf(stderr, "Failed to get the stats of event %u on client %d.\n", handle->event_id, session_id);
+    return 1;
+  }
+
+  if (reader_read(reader, &stats->rows, sizeof(size_t)) != 0 ||
+      reader_read(reader, &stats->cols, sizeof(size_t)) != 0 ||
+      reader_read(reader, &stats->free_seats, sizeof(size_t)) != 0 ||
+      reader_read(reader, &stats->reservations, sizeof(unsigned int)) != 0 ||
+      reader_read(reader, &stats->cache_hits, sizeof(size_t)) != 0 ||
+      reader_read(reader, &stats->cache_misses, sizeof(size_t)) != 0) {
+    fprintf(stderr, "Failed to read the stats from the response.\n");
+    return 1;
+  }
+
+  if (!handle->with_rows) {
+    return 0;
+  }
+
+  if (stats->rows > (reader->size - reader->pos) / sizeof(size_t) ||
+      (stats->row_reserved = malloc(sizeof(size_t) * (stats->rows > 0 ? stats->rows : 1))) == NULL ||
+      reader_read(reader, stats->row_reserved, sizeof(size_t) * stats->rows) != 0) {
+    fprintf(stderr, "Failed to read the rows from the response.\n");
+    free(stats->row_reserved);
+    stats->row_reserved = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+/// Reads the response to a GET_RESERVATION request into the reservation of its handle.
+/// @param handle The handle of the GET_RESERVATION request.
+/// @param reader Reader over the payload of the response.
+/// @return 0 if the seats were read successfully, 1 otherwise.
+static int finish_get_reservation(struct EmsHandle* handle, struct Reader* reader) {
+  struct EmsReservation* reservation = handle->reservation;
+  *reservation = (struct EmsReservation){0, NULL, NULL};
+
+  if (read_return_value(reader) != SUCCESS_MSG) {
+    fprintf(stderr, "Failed to get a reservation of event %u on client %d.\n", handle->event_id, session_id);
+    return 1;
+  }
+
+  // Every seat takes between 1 and VARINT_MAX_SIZE bytes
+  size_t num_seats, encoded_size;
+  const unsigned char* encoded = NULL;
+  if (reader_read(reader, &num_seats, sizeof(size_t)) != 0 || reader_read(reader, &encoded_size, sizeof(size_t)) != 0 ||
+      (encoded = reader_take(reader, encoded_size)) == NULL || num_seats == 0 || encoded_size < num_seats ||
+      (reservation->xs = malloc(sizeof(size_t) * num_seats)) == NULL ||
+      (reservation->ys = malloc(sizeof(size_t) * num_seats)) == NULL ||
+      seats_decode(encoded, encoded_size, num_seats, reservation->xs, reservation->ys) != 0) {
+    fprintf(stderr, "Failed to read the seats of the reservation from the response.\n");
+    free(reservation->xs);
+    free(reservation->ys);
+    *reservation = (struct EmsReservation){0, NULL, NULL};
+    return 1;
   }
 
+  reservation->num_seats = num_seats;
   return 0;
 }
 
-int ems_list_events(int out_fd) {
-  char OP_CODE = EMS_LIST_CODE;
-  size_t num_events;
-  unsigned int* ids;
+/// Reads the outcome of a RUN_JOBS request, whose output was already written as it arrived.
+/// @param handle The handle of the RUN_JOBS request.
+/// @param reader Reader over the payload of the final frame.
+/// @return 0 if the whole script ran and its output was written, 1 otherwise.
+static int finish_run_jobs(struct EmsHandle* handle, struct Reader* reader) {
+  char last;
+  int return_value = FAIL_MSG;
+  size_t failed = 0;
+  if (reader->data == NULL || reader_read(reader, &last, sizeof(char)) != 0 ||
+      reader_read(reader, &return_value, sizeof(int)) != 0 || reader_read(reader, &failed, sizeof(size_t)) != 0) {
+    return_value = FAIL_MSG;
+  }
 
-  if (write(fd_req, &OP_CODE, sizeof(char)) == -1) {
-    fprintf(stderr, "Failed to write the OP_CODE on the request pipe.\n");
+  if (return_value != SUCCESS_MSG) {
+    fprintf(stderr, "Failed to run a job file on client %d.\n", session_id);
     return 1;
   }
-  
+
+  if (failed > 0) {
+    fprintf(stderr, "%zu commands of the job file failed.\n", failed);
+  }
+  return handle->output_failed;
+}
+
+/// Waits for the response of a request and processes it.
+/// @note The session lock must be held, and every earlier request of the session must be finished.
+/// @param handle The handle of the request.
+static void finish_request(struct EmsHandle* handle) {
+  pthread_mutex_lock(&recv_mutex);
+  while (!handle->received) {
+    pthread_cond_wait(&recv_cond, &recv_mutex);
+  }
+  pthread_mutex_unlock(&recv_mutex);
+
+  struct Reader reader = {handle->payload, handle->size, 0};
   int return_value;
-  if (read(fd_resp, &return_value, sizeof(int)) == -1) {
-    fprintf(stderr, "Failed to read response sent by server.\n");
-    return 1;
+  switch (handle->op) {
+    case EMS_CREATE_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to create an event on client %d, with error value %d.\n", session_id, return_value);
+      } else {
+        // The event is addressed by handle from now on
+        read_event_handle(handle->session, &reader);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_CREATE_MANY_CODE:
+    case EMS_CREATE_FROM_TEMPLATE_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to create events on client %d, with error value %d.\n", session_id, return_value);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_CREATE_TEMPLATE_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to create a template on client %d, with error value %d.\n", session_id, return_value);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_IMPORT_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to import a dump on client %d, with error value %d.\n", session_id, return_value);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_OPEN_EVENT_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to open event %u on client %d.\n", handle->event_id, session_id);
+      } else {
+        read_event_handle(handle->session, &reader);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_RESERVE_CODE:
+      return_value = read_return_value(&reader);
+      printf("Reponse -> %d\n", return_value);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to reserve a seat on an event on client %d.\n", session_id);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_RESERVE_RANGES_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to reserve a range of seats on an event on client %d.\n", session_id);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_RESERVE_BEST_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to reserve adjacent seats on event %u on client %d.\n", handle->event_id, session_id);
+      } else if (reader_read(&reader, handle->reserved, sizeof(struct SeatRange)) != 0) {
+        fprintf(stderr, "Failed to read the reserved seats from the response.\n");
+        return_value = FAIL_MSG;
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_CANCEL_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to cancel a reservation of event %u on client %d.\n", handle->event_id, session_id);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_GET_RESERVATION_CODE:
+      handle->result = finish_get_reservation(handle, &reader);
+      break;
+
+    case EMS_RESERVE_MULTI_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to reserve seats on several events on client %d.\n", session_id);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_RUN_JOBS_CODE:
+      handle->result = finish_run_jobs(handle, &reader);
+      break;
+
+    case EMS_SUBSCRIBE_CODE:
+      return_value = read_return_value(&reader);
+      if (return_value != SUCCESS_MSG) {
+        fprintf(stderr, "Failed to subscribe to events on client %d.\n", session_id);
+      }
+      handle->result = return_value != SUCCESS_MSG;
+      break;
+
+    case EMS_SHOW_SINCE_CODE:
+      handle->result = finish_show(handle, &reader);
+      break;
+
+    case EMS_LIST_CODE:
+      handle->result = finish_list(handle, &reader);
+      break;
+
+    case EMS_LIST_RANGE_CODE:
+      handle->result = finish_list_range(handle, &reader);
+      break;
+
+    case EMS_SHOW_MANY_CODE:
+      handle->result = finish_show_many(handle, &reader);
+      break;
+
+    case EMS_STATS_CODE:
+      handle->result = finish_stats(handle, &reader);
+      break;
+
+    default:
+      handle->result = 1;
+      break;
   }
 
-  if (return_value == SUCCESS_MSG) {
-    if (read(fd_resp, &num_events, sizeof(size_t)) == -1) {
-      fprintf(stderr, "Failed to read the number of events from the response pipe.\n");
-      return 1;
-    }
-    ids = (unsigned int*) malloc(sizeof(unsigned int) * num_events);
-    if (read(fd_resp, ids, sizeof(unsigned int) * (num_events)) == -1) {
-      fprintf(stderr, "Failed to read the ids of the events from the response pipe.\n");
-      return 1;
+  free(handle->payload);
+  handle->payload = NULL;
+  handle->finished = 1;
+}
+
+struct EmsHandle* ems_show_async(int out_fd, unsigned int event_id) {
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+
+  // Only ask for what changed since the grid we already have, or will have once earlier SHOWs are done
+  struct CachedGrid* grid = get_cached_grid(session, event_id);
+  unsigned int version = grid != NULL ? grid->version : 0;
+  struct EventRef event = get_event_ref(session, event_id);
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &event, sizeof(struct EventRef)) != 0 ||
+      buffer_append(&request, &version, sizeof(unsigned int)) != 0) {
+    fprintf(stderr, "Failed to build the show request.\n");
+    buffer_free(&request);
+    pthread_mutex_unlock(&session->lock);
+    return NULL;
+  }
+
+  struct EmsHandle* handle = issue(session, EMS_SHOW_SINCE_CODE, &request);
+  if (handle != NULL) {
+    handle->out_fd = out_fd;
+    handle->event_id = event_id;
+    handle->grid = grid;
+    if (grid != NULL) {
+      grid->in_flight++;
     }
-    fprintf(stderr, "fd -> %d.\n", out_fd);
   }
-  else {
-    fprintf(stderr, "Failed to show an event on client %d.\n", session_id);
+  pthread_mutex_unlock(&session->lock);
+  return handle;
+}
+
+int ems_show(int out_fd, unsigned int event_id) { return ems_wait(ems_show_async(out_fd, event_id)); }
+
+struct EmsHandle* ems_show_many_async(int out_fd, size_t num_events, const unsigned int* event_ids, int* results) {
+  if (num_events == 0 || num_events > EMS_SHOW_MANY_MAX_EVENTS) {
+    fprintf(stderr, "A SHOW_MANY must name between 1 and %d events.\n", EMS_SHOW_MANY_MAX_EVENTS);
+    return NULL;
+  }
+
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &num_events, sizeof(size_t)) != 0 ||
+      buffer_append(&request, event_ids, sizeof(unsigned int) * num_events) != 0) {
+    fprintf(stderr, "Failed to build the show request.\n");
+    buffer_free(&request);
+    return NULL;
+  }
+
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* handle = issue(session, EMS_SHOW_MANY_CODE, &request);
+  if (handle != NULL) {
+    handle->out_fd = out_fd;
+    handle->results = results;
+    handle->num_results = num_events;
+  }
+  pthread_mutex_unlock(&session->lock);
+  return handle;
+}
+
+int ems_show_many(int out_fd, size_t num_events, const unsigned int* event_ids, int* results) {
+  return ems_wait(ems_show_many_async(out_fd, num_events, event_ids, results));
+}
+
+struct EmsHandle* ems_stats_async(unsigned int event_id, int with_rows, struct EmsEventStats* stats) {
+  struct Session* session = current_session();
+  pthread_mutex_lock(&session->lock);
+
+  struct EventRef event = get_event_ref(session, event_id);
+  char rows = with_rows != 0;
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &event, sizeof(struct EventRef)) != 0 ||
+      buffer_append(&request, &rows, sizeof(char)) != 0) {
+    fprintf(stderr, "Failed to build the stats request.\n");
+    buffer_free(&request);
+    pthread_mutex_unlock(&session->lock);
+    return NULL;
+  }
+
+  struct EmsHandle* handle = issue(session, EMS_STATS_CODE, &request);
+  if (handle != NULL) {
+    handle->event_id = event_id;
+    handle->stats = stats;
+    handle->with_rows = rows;
+  }
+  pthread_mutex_unlock(&session->lock);
+  return handle;
+}
+
+int ems_stats(unsigned int event_id, int with_rows, struct EmsEventStats* stats) {
+  return ems_wait(ems_stats_async(event_id, with_rows, stats));
+}
+
+struct EmsHandle* ems_list_events_async(int out_fd) {
+  struct Session* session = current_session();
+  struct Buffer request = {NULL, 0, 0};
+
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* handle = issue(session, EMS_LIST_CODE, &request);
+  if (handle != NULL) {
+    handle->out_fd = out_fd;
+  }
+  pthread_mutex_unlock(&session->lock);
+  return handle;
+}
+
+int ems_list_events(int out_fd) { return ems_wait(ems_list_events_async(out_fd)); }
+
+struct EmsHandle* ems_list_range_async(int out_fd, unsigned int last_id, size_t min_free_seats, size_t limit,
+                                       struct EmsListCursor* cursor) {
+  struct Session* session = current_session();
+  struct Buffer request = {NULL, 0, 0};
+  if (buffer_append(&request, &cursor->next_id, sizeof(unsigned int)) != 0 ||
+      buffer_append(&request, &last_id, sizeof(unsigned int)) != 0 ||
+      buffer_append(&request, &min_free_seats, sizeof(size_t)) != 0 ||
+      buffer_append(&request, &limit, sizeof(size_t)) != 0) {
+    fprintf(stderr, "Failed to build the list request.\n");
+    buffer_free(&request);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* handle = issue(session, EMS_LIST_RANGE_CODE, &request);
+  if (handle != NULL) {
+    handle->out_fd = out_fd;
+    handle->cursor = cursor;
+  }
+  pthread_mutex_unlock(&session->lock);
+  return handle;
+}
+
+int ems_list_range(int out_fd, unsigned int last_id, size_t min_free_seats, size_t limit,
+                   struct EmsListCursor* cursor) {
+  struct EmsHandle* handle = ems_list_range_async(out_fd, last_id, min_free_seats, limit, cursor);
+  if (handle == NULL) {
+    cursor->more = 0;
+  }
+  return ems_wait(handle);
+}
+
+int ems_poll(struct EmsHandle* handle) {
+  if (handle == NULL) {
     return 1;
   }
 
-  for (int i = 0; i < (int) num_events; i++) {
-    char event_string[] = "Event: ";
-    char id = (char)(ids[i] + '0');
-    char end_line = '\n';
+  pthread_mutex_lock(&recv_mutex);
+  int received = handle->received;
+  pthread_mutex_unlock(&recv_mutex);
+  return received;
+}
 
-    if(write(out_fd, &event_string, sizeof(event_string) - 1) == -1) {
-      fprintf(stderr, "Failed to write event in .out file.\n");
-    }
-    if(write(out_fd, &id, sizeof(id)) == -1) {
-      fprintf(stderr, "Failed to write event in .out file.\n");
+int ems_wait(struct EmsHandle* handle) {
+  if (handle == NULL) {
+    return 1;
+  }
+
+  // Responses are processed in issue order, so SHOW deltas always apply to the grid they were computed against
+  struct Session* session = handle->session;
+  pthread_mutex_lock(&session->lock);
+  struct EmsHandle* prev = NULL;
+  for (struct EmsHandle* current = session->issued_head; current != handle; current = current->next_issued) {
+    if (!current->finished) {
+      finish_request(current);
     }
-    if(write(out_fd, &end_line, sizeof(end_line)) == -1) {
-      fprintf(stderr, "Failed to write event in .out file.\n");
+    prev = current;
+  }
+  if (!handle->finished) {
+    finish_request(handle);
+  }
+
+  if (prev == NULL) {
+    session->issued_head = handle->next_issued;
+  } else {
+    prev->next_issued = handle->next_issued;
+  }
+  if (session->issued_tail == handle) {
+    session->issued_tail = prev;
+  }
+  pthread_mutex_unlock(&session->lock);
+
+  int result = handle->result;
+  free(handle);
+  return result;
+}
+
+int ems_wait_all(void) {
+  struct Session* session = current_session();
+  int result = 0;
+
+  while (1) {
+    pthread_mutex_lock(&session->lock);
+    struct EmsHandle* handle = session->issued_head;
+    pthread_mutex_unlock(&session->lock);
+    if (handle == NULL) {
+      return result;
     }
+    result |= ems_wait(handle);
   }
-  return 0;
 }
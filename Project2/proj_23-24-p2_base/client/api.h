@@ -3,6 +3,10 @@
 
 #include <stddef.h>
 
+#include "common/codec.h"
+
+/// Request issued by one of the *_async functions, until ems_wait consumes its response.
+struct EmsHandle;
 
 /// Connects to an EMS server.
 /// @param req_pipe_path Path to the name pipe to be created for requests.
@@ -11,10 +15,26 @@
 /// @return 0 if the connection was established successfully, 1 otherwise.
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path);
 
+/// Opens a new logical session on the existing connection for the calling thread.
+/// @note Requests made by the thread use this session until it is closed, and the main session otherwise.
+/// @return 0 if the session was opened successfully, 1 otherwise.
+int ems_session_open(void);
+
+/// Closes the logical session of the calling thread.
+/// @return 0 if the session was closed successfully, 1 otherwise.
+int ems_session_close(void);
+
 /// Disconnects from an EMS server.
 /// @return 0 in case of success, 1 otherwise.
 int ems_quit(void);
 
+/// Sends a CREATE without waiting for its response.
+/// @param event_id Id of the event to be created.
+/// @param num_rows Number of rows of the event to be created.
+/// @param num_cols Number of columns of the event to be created.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_create_async(unsigned int event_id, size_t num_rows, size_t num_cols);
+
 /// Creates a new event with the given id and dimensions.
 /// @param event_id Id of the event to be created.
 /// @param num_rows Number of rows of the event to be created.
@@ -22,6 +42,100 @@ int ems_quit(void);
 /// @return 0 if the event was created successfully, 1 otherwise.
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 
+/// Sends a CREATE_MANY without waiting for its response.
+/// @param num_events Number of events to be created.
+/// @param event_ids Array of ids of the events to be created.
+/// @param num_rows Number of rows of each event.
+/// @param num_cols Number of columns of each event.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_create_many_async(size_t num_events, const unsigned int* event_ids, size_t num_rows,
+                                        size_t num_cols);
+
+/// Creates several events with the same dimensions in a single request.
+/// @note Either every event is created or none is.
+/// @param num_events Number of events to be created.
+/// @param event_ids Array of ids of the events to be created.
+/// @param num_rows Number of rows of each event.
+/// @param num_cols Number of columns of each event.
+/// @return 0 if the events were created successfully, 1 otherwise.
+int ems_create_many(size_t num_events, const unsigned int* event_ids, size_t num_rows, size_t num_cols);
+
+/// Creates every event of a range of ids in a single request.
+/// @note Either every event is created or none is.
+/// @param first_id Id of the first event to be created.
+/// @param last_id Id of the last event to be created.
+/// @param num_rows Number of rows of each event.
+/// @param num_cols Number of columns of each event.
+/// @return 0 if the events were created successfully, 1 otherwise.
+int ems_create_range(unsigned int first_id, unsigned int last_id, size_t num_rows, size_t num_cols);
+
+/// Sends a CREATE_TEMPLATE without waiting for its response.
+/// @param template_id Id of the template, templates and events have ids of their own.
+/// @param num_rows Number of rows of the venue.
+/// @param num_cols Number of columns of the venue.
+/// @param num_blocked Number of pre-blocked seats, 0 for none.
+/// @param xs Array of rows of the pre-blocked seats.
+/// @param ys Array of columns of the pre-blocked seats.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_create_template_async(unsigned int template_id, size_t num_rows, size_t num_cols,
+                                            size_t num_blocked, const size_t* xs, const size_t* ys);
+
+/// Creates a venue template, which events with its dimensions and pre-blocked seats can be created from.
+/// @note The pre-blocked seats become reservation 1 of every event created from the template.
+/// @param template_id Id of the template, templates and events have ids of their own.
+/// @param num_rows Number of rows of the venue.
+/// @param num_cols Number of columns of the venue.
+/// @param num_blocked Number of pre-blocked seats, 0 for none.
+/// @param xs Array of rows of the pre-blocked seats.
+/// @param ys Array of columns of the pre-blocked seats.
+/// @return 0 if the template was created successfully, 1 otherwise.
+int ems_create_template(unsigned int template_id, size_t num_rows, size_t num_cols, size_t num_blocked,
+                        const size_t* xs, const size_t* ys);
+
+/// Sends a CREATE_FROM_TEMPLATE without waiting for its response.
+/// @param template_id Id of the template.
+/// @param num_events Number of events to be created.
+/// @param event_ids Array of ids of the events to be created.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_create_from_template_async(unsigned int template_id, size_t num_events,
+                                                 const unsigned int* event_ids);
+
+/// Creates several events from a template in a single request.
+/// @note Either every event is created or none is. The events share the template's seats on the server until
+///       they are reserved, so memory grows with the seats reserved rather than with the size of the venue.
+/// @param template_id Id of the template.
+/// @param num_events Number of events to be created.
+/// @param event_ids Array of ids of the events to be created.
+/// @return 0 if the events were created successfully, 1 otherwise.
+int ems_create_from_template(unsigned int template_id, size_t num_events, const unsigned int* event_ids);
+
+/// Sends an IMPORT without waiting for its response.
+/// @param name Name of the dump in the import directory of the server.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_import_async(const char* name);
+
+/// Has the server create every event and reservation of a CSV dump, such as a snapshot of another server.
+/// @note The server reads the dump itself, in parallel, from the directory it was started with, and either imports
+///       all of it or nothing. See server/import.h for its format.
+/// @param name Name of the dump in the import directory of the server.
+/// @return 0 if the dump was imported successfully, 1 otherwise.
+int ems_import(const char* name);
+
+/// Opens an event for the calling thread's session, so its later requests address it by handle.
+/// @note Handles skip the event lookup on the server. Sessions get one for every event they create, without this.
+/// @param event_id Id of the event to open.
+/// @return 0 if the event was opened successfully, 1 otherwise.
+int ems_open_event(unsigned int event_id);
+
+/// Sends a RESERVE without waiting for its response.
+/// @note The seats are copied, the arrays can be reused as soon as this returns.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_reserve_async(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
+
 /// Creates a new reservation for the given event.
 /// @param event_id Id of the event to create a reservation for.
 /// @param num_seats Number of seats to reserve.
@@ -30,15 +144,244 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
 
+/// Sends a reservation from ranges of seats without waiting for its response.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_ranges Number of ranges to reserve.
+/// @param ranges Array of ranges of seats to reserve.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_reserve_ranges_async(unsigned int event_id, size_t num_ranges, const struct SeatRange* ranges);
+
+/// Creates a new reservation for the given event from ranges of seats.
+/// @note Falls back to a plain RESERVE when every range is a single seat.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_ranges Number of ranges to reserve.
+/// @param ranges Array of ranges of seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_ranges(unsigned int event_id, size_t num_ranges, const struct SeatRange* ranges);
+
+/// Sends a RESERVE_BEST without waiting for its response.
+/// @note The seats are filled in when the request is waited for.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of adjacent seats to reserve.
+/// @param near_row Row the seats should be closest to.
+/// @param reserved Pointer to the variable to store the reserved seats in, must outlive the request.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_reserve_best_async(unsigned int event_id, size_t num_seats, size_t near_row,
+                                         struct SeatRange* reserved);
+
+/// Reserves adjacent seats in one row, in the row nearest to the one asked for that has room for them.
+/// @note The server picks the seats, so there is nothing to retry when another client gets a seat first.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of adjacent seats to reserve.
+/// @param near_row Row the seats should be closest to.
+/// @param reserved Pointer to the variable to store the reserved seats in.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_best(unsigned int event_id, size_t num_seats, size_t near_row, struct SeatRange* reserved);
+
+/// Sends a CANCEL without waiting for its response.
+/// @param event_id Id of the event the reservation is for.
+/// @param reservation_id Id of the reservation to cancel.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_cancel_async(unsigned int event_id, unsigned int reservation_id);
+
+/// Cancels a reservation, freeing its seats.
+/// @param event_id Id of the event the reservation is for.
+/// @param reservation_id Id of the reservation to cancel.
+/// @return 0 if the reservation was cancelled successfully, 1 otherwise.
+int ems_cancel(unsigned int event_id, unsigned int reservation_id);
+
+/// Seats of a reservation, as reported by the server.
+struct EmsReservation {
+  size_t num_seats;  /// Number of seats.
+  size_t* xs;        /// Array of rows of the seats, freed by the caller.
+  size_t* ys;        /// Array of columns of the seats, freed by the caller.
+};
+
+/// Sends a GET_RESERVATION without waiting for its response.
+/// @note The seats are filled in when the request is waited for.
+/// @param event_id Id of the event the reservation is for.
+/// @param reservation_id Id of the reservation.
+/// @param reservation Pointer to the variable to store the seats in, must outlive the request.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_get_reservation_async(unsigned int event_id, unsigned int reservation_id,
+                                            struct EmsReservation* reservation);
+
+/// Gets the seats of a reservation.
+/// @param event_id Id of the event the reservation is for.
+/// @param reservation_id Id of the reservation.
+/// @param reservation Pointer to the variable to store the seats in.
+/// @return 0 if the seats were received successfully, 1 if there is no such reservation or it was cancelled.
+int ems_get_reservation(unsigned int event_id, unsigned int reservation_id, struct EmsReservation* reservation);
+
+/// Seats to reserve in one event, as part of a reservation spanning several events.
+struct EmsReservePart {
+  unsigned int event_id;           /// Id of the event to reserve the seats in.
+  size_t num_ranges;               /// Number of ranges, at most MAX_RESERVATION_SIZE.
+  const struct SeatRange* ranges;  /// Array of ranges of seats.
+};
+
+/// Sends a reservation spanning several events without waiting for its response.
+/// @param num_parts Number of parts, at most EMS_MULTI_MAX_EVENTS.
+/// @param parts Array of parts, one event may appear in several of them.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_reserve_multi_async(size_t num_parts, const struct EmsReservePart* parts);
+
+/// Creates one reservation in each of several events, atomically.
+/// @note Either every seat of every part is reserved or none is, so a bundle can't be left half booked.
+/// @param num_parts Number of parts, at most EMS_MULTI_MAX_EVENTS.
+/// @param parts Array of parts, one event may appear in several of them.
+/// @return 0 if every reservation was created successfully, 1 otherwise.
+int ems_reserve_multi(size_t num_parts, const struct EmsReservePart* parts);
+
+/// Sends a SHOW without waiting for its response.
+/// @note The event is printed to the file when the request is waited for.
+/// @param out_fd File descriptor to print the event to.
+/// @param event_id Id of the event to print.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_show_async(int out_fd, unsigned int event_id);
+
 /// Prints the given event to the given file.
 /// @param out_fd File descriptor to print the event to.
 /// @param event_id Id of the event to print.
 /// @return 0 if the event was printed successfully, 1 otherwise.
 int ems_show(int out_fd, unsigned int event_id);
 
+/// Sends a SHOW_MANY without waiting for its response.
+/// @note The events are printed to the file when the request is waited for.
+/// @param out_fd File descriptor to print the events to.
+/// @param num_events Number of events to print, at most EMS_SHOW_MANY_MAX_EVENTS.
+/// @param event_ids Array of ids of the events.
+/// @param results Array to store whether each event failed in, 0 if it was printed. May be NULL.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_show_many_async(int out_fd, size_t num_events, const unsigned int* event_ids, int* results);
+
+/// Prints several events to a file with a single request, one after the other as SHOW would.
+/// @note A missing event is skipped and marked as failed, the others are still printed.
+/// @param out_fd File descriptor to print the events to.
+/// @param num_events Number of events to print, at most EMS_SHOW_MANY_MAX_EVENTS.
+/// @param event_ids Array of ids of the events.
+/// @param results Array to store whether each event failed in, 0 if it was printed. May be NULL.
+/// @return 0 if every event was printed successfully, 1 otherwise.
+int ems_show_many(int out_fd, size_t num_events, const unsigned int* event_ids, int* results);
+
+/// Sends a LIST without waiting for its response.
+/// @note The events are printed to the file when the request is waited for.
+/// @param out_fd File descriptor to print the events to.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_list_events_async(int out_fd);
+
 /// Prints all the events to the given file.
 /// @param out_fd File descriptor to print the events to.
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(int out_fd);
 
+/// Position of a range LIST, moved past each page so the next one resumes where it stopped.
+struct EmsListCursor {
+  unsigned int next_id;  /// Lowest id of the next page, set to the start of the range before the first one.
+  int more;              /// Whether events of the range may be left, the last page can come back empty.
+};
+
+/// Sends a LIST_RANGE without waiting for its response.
+/// @note The events are printed and the cursor moved when the request is waited for.
+/// @param out_fd File descriptor to print the events to.
+/// @param last_id Highest id wanted.
+/// @param min_free_seats Events with fewer free seats are skipped, 0 to list every event.
+/// @param limit Most events in the page, up to EMS_LIST_PAGE_SIZE, 0 for that many.
+/// @param cursor Cursor of the range, must outlive the request.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_list_range_async(int out_fd, unsigned int last_id, size_t min_free_seats, size_t limit,
+                                       struct EmsListCursor* cursor);
+
+/// Prints one page of the events with ids from cursor->next_id to last_id, in id order, as LIST would.
+/// @note The server finds the first event through its id index, so a page costs O(log n) plus its range.
+/// @param out_fd File descriptor to print the events to.
+/// @param last_id Highest id wanted.
+/// @param min_free_seats Events with fewer free seats are skipped, 0 to list every event.
+/// @param limit Most events in the page, up to EMS_LIST_PAGE_SIZE, 0 for that many.
+/// @param cursor Cursor of the range, call again while cursor->more is set.
+/// @return 0 if the page was printed successfully, 1 otherwise.
+int ems_list_range(int out_fd, unsigned int last_id, size_t min_free_seats, size_t limit,
+                   struct EmsListCursor* cursor);
+
+/// Occupancy of an event, as reported by the server.
+struct EmsEventStats {
+  size_t rows;                /// Number of rows.
+  size_t cols;                /// Number of columns.
+  size_t free_seats;          /// Number of seats not reserved yet.
+  unsigned int reservations;  /// Number of reservations made.
+  size_t cache_hits;          /// Requests of this session that found their event in the server cache.
+  size_t cache_misses;        /// Requests of this session that had to look their event up, this one included if it did.
+  size_t* row_reserved;       /// Taken seats of each row if requested, NULL otherwise. Freed by the caller.
+};
+
+/// Sends a STATS request without waiting for its response.
+/// @note The stats are filled in when the request is waited for.
+/// @param event_id Id of the event to describe.
+/// @param with_rows Whether the number of taken seats of every row is wanted too.
+/// @param stats Pointer to the variable to store the stats in, must outlive the request.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_stats_async(unsigned int event_id, int with_rows, struct EmsEventStats* stats);
+
+/// Gets the occupancy of an event without transferring its seats.
+/// @note The occupancy of row i in percent is 100 * row_reserved[i] / cols.
+/// @param event_id Id of the event to describe.
+/// @param with_rows Whether the number of taken seats of every row is wanted too.
+/// @param stats Pointer to the variable to store the stats in.
+/// @return 0 if the stats were received successfully, 1 otherwise.
+int ems_stats(unsigned int event_id, int with_rows, struct EmsEventStats* stats);
+
+/// Sends a whole .jobs script to be run by the server, without waiting for it to finish.
+/// @note What the script prints is written to the file as it arrives, in the format of a client-run .jobs file.
+/// @param out_fd File descriptor to write the output of the script to.
+/// @param script The script to run.
+/// @param size Size of the script.
+/// @return Handle of the request, NULL if it could not be sent.
+struct EmsHandle* ems_run_jobs_async(int out_fd, const char* script, size_t size);
+
+/// Runs a whole .jobs script on the server, writing what it prints to the given file.
+/// @param out_fd File descriptor to write the output of the script to.
+/// @param script The script to run.
+/// @param size Size of the script.
+/// @return 0 if the script ran and its output was written, 1 otherwise.
+int ems_run_jobs(int out_fd, const char* script, size_t size);
+
+/// Seat changes of an event, pushed to a subscriber.
+struct EmsNotification {
+  unsigned int event_id;
+  unsigned int version;          /// Version of the event after the changes.
+  int dropped;                   /// Whether changes were dropped because the client fell behind, SHOW to resync.
+  size_t num_changes;            /// Number of changes, 0 if they were dropped.
+  const unsigned int* changes;   /// (seat index, reservation id) pairs, oldest first.
+};
+
+/// Called with every notification of a subscription.
+/// @param notification The notification, only valid during the call.
+/// @param arg Argument given to ems_subscribe.
+typedef void (*ems_notify_callback)(const struct EmsNotification* notification, void* arg);
+
+/// Subscribes the calling thread's session to the seat changes of some events.
+/// @note The callback runs on the thread reading responses, so it must not wait for requests. Changes made by
+///       several reservations may come in one notification, and none come once the session is closed.
+/// @param num_events Number of events to subscribe to.
+/// @param event_ids Array of ids of the events.
+/// @param callback Function called with every notification.
+/// @param arg Passed to the callback as is.
+/// @return 0 if the session was subscribed to every event, 1 otherwise.
+int ems_subscribe(size_t num_events, const unsigned int* event_ids, ems_notify_callback callback, void* arg);
+
+/// Checks whether the response of a request has arrived, without blocking.
+/// @param handle Handle of the request.
+/// @return 1 if ems_wait would not have to wait for the server, 0 otherwise.
+int ems_poll(struct EmsHandle* handle);
+
+/// Waits for the response of a request, processes it and frees the handle.
+/// @note Earlier requests of the same session are processed first, in the order they were issued.
+/// @param handle Handle of the request, NULL for a request that could not be sent.
+/// @return 0 if the request succeeded, 1 otherwise.
+int ems_wait(struct EmsHandle* handle);
+
+/// Waits for every request the calling thread's session has not waited for yet.
+/// @return 0 if all of them succeeded, 1 otherwise.
+int ems_wait_all(void);
+
 #endif  // CLIENT_API_H
@@ -8,96 +8,138 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "api.h"
 #include "common/constants.h"
-#include "parser.h"
+#include "common/parser.h"
 #include "main.h"
 
-int main(int argc, char* argv[]) {
-  if (argc < 5) {
-    fprintf(stderr, "Usage: %s <request pipe path> <response pipe path> <server pipe path> <.jobs file path>\n",
-            argv[0]);
+// Job files to run, shared by the job threads
+static char** job_paths = NULL;
+static size_t num_job_paths = 0;
+static size_t next_job_path = 0;
+static pthread_mutex_t job_paths_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int run_on_server = 0;  // Whether whole job files are sent to the server to run, set by -s
+
+/// Adds a job file to the list of files to run.
+/// @param path Path of the .jobs file.
+/// @return 0 if the file was added, 1 if it is not a valid .jobs path or there was no memory for it.
+static int add_job_path(const char* path) {
+  const char* dot = strrchr(path, '.');
+  if (dot == NULL || dot == path || strlen(dot) != 5 || strcmp(dot, ".jobs") || strlen(path) >= MAX_JOB_FILE_NAME_SIZE) {
+    fprintf(stderr, "The provided .jobs file path is not valid. Path: %s\n", path);
     return 1;
   }
 
-  if (ems_setup(argv[1], argv[2], argv[3])) {
-    fprintf(stderr, "Failed to set up EMS\n");
+  char** paths = realloc(job_paths, sizeof(char*) * (num_job_paths + 1));
+  if (paths == NULL) {
+    fprintf(stderr, "Failed to allocate memory for the job files.\n");
     return 1;
   }
+  job_paths = paths;
 
-  // Opening of the Fifo files
-  // printf("Opening Request file...\n");
-  // fd_req = open(argv[1], O_WRONLY);
-  // Vai estar a espera que alguem leia
-  // if (fd_req == -1) {
-  //   fprintf(stderr, "[ERR]: open failed: %s\n", strerror(errno));
-  //   exit(EXIT_FAILURE);
-  // }
-  // printf("Opened Request file!\n");
-
-  // printf("Opening response...\n");
-  // fd_resp = open(argv[2], O_RDONLY);
-  // // Vai estar a espera que alguem escreva resposta
-  // if (fd_resp == -1) {
-  //   fprintf(stderr, "[ERR]: open failed: %s\n", strerror(errno));
-  //   exit(EXIT_FAILURE);
-  // }
-  // printf("Opened Response file!\n");
-  // Finished oppening them
-
-  const char* dot = strrchr(argv[4], '.');
-  if (dot == NULL || dot == argv[4] || strlen(dot) != 5 || strcmp(dot, ".jobs") ||
-      strlen(argv[4]) > MAX_JOB_FILE_NAME_SIZE) {
-    fprintf(stderr, "The provided .jobs file path is not valid. Path: %s\n", argv[1]);
+  job_paths[num_job_paths] = strdup(path);
+  if (job_paths[num_job_paths] == NULL) {
+    fprintf(stderr, "Failed to allocate memory for the job files.\n");
     return 1;
   }
+  num_job_paths++;
+  return 0;
+}
 
+/// Adds every .jobs file in a directory to the list of files to run.
+/// @param dir_path Path of the directory.
+/// @param dir Open directory stream, closed by this function.
+/// @return 0 if the files were added, 1 otherwise.
+static int add_job_dir(const char* dir_path, DIR* dir) {
+  int result = 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char* dot = strrchr(entry->d_name, '.');
+    if (dot == NULL || strcmp(dot, ".jobs") != 0) {
+      continue;
+    }
+
+    char path[PATH_MAX];
+    if (snprintf(path, PATH_MAX, "%s/%s", dir_path, entry->d_name) >= PATH_MAX || add_job_path(path) != 0) {
+      result = 1;
+    }
+  }
+
+  closedir(dir);
+  return result;
+}
+
+/// Runs the commands of a .jobs file, writing what they print to the matching .out file.
+/// @param jobs_path Path of the .jobs file.
+/// @return 0 if the file was run, 1 if it could not be opened.
+static int run_job_file(const char* jobs_path) {
   char out_path[MAX_JOB_FILE_NAME_SIZE];
-  strcpy(out_path, argv[4]);
+  strcpy(out_path, jobs_path);
   strcpy(strrchr(out_path, '.'), ".out");
 
-  int in_fd = open(argv[4], O_RDONLY);
-  if (in_fd == -1) {
-    fprintf(stderr, "Failed to open input file. Path: %s\n", argv[4]);
+  struct JobFile jobs;
+  if (job_file_open(jobs_path, &jobs) != 0) {
+    fprintf(stderr, "Failed to open input file. Path: %s\n", jobs_path);
     return 1;
   }
 
   int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
   if (out_fd == -1) {
     fprintf(stderr, "Failed to open output file. Path: %s\n", out_path);
+    job_file_close(&jobs);
     return 1;
   }
 
+  if (run_on_server) {
+    int result = ems_run_jobs(out_fd, jobs.data, jobs.size);
+    if (result) fprintf(stderr, "Failed to run job file on the server. Path: %s\n", jobs_path);
+    job_file_close(&jobs);
+    close(out_fd);
+    return result;
+  }
+
+  struct Span in = {jobs.data, jobs.data + jobs.size};
+
   while (1) {
-    unsigned int event_id;
+    unsigned int event_id, last_event_id;
     size_t num_rows, num_columns, num_coords;
     unsigned int delay = 0;
-    size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+    struct SeatRange ranges[MAX_RESERVATION_SIZE];
 
-    switch (get_next(in_fd)) {
+    switch (get_next(&in)) {
       case CMD_CREATE:
-        if (parse_create(in_fd, &event_id, &num_rows, &num_columns) != 0) {
+        if (parse_create(&in, &event_id, &last_event_id, &num_rows, &num_columns) != 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
-        if (ems_create(event_id, num_rows, num_columns)) fprintf(stderr, "Failed to create event\n");
+        if (last_event_id != event_id) {
+          if (ems_create_range(event_id, last_event_id, num_rows, num_columns)) {
+            fprintf(stderr, "Failed to create events\n");
+          }
+        } else if (ems_create(event_id, num_rows, num_columns)) {
+          fprintf(stderr, "Failed to create event\n");
+        }
         break;
 
       case CMD_RESERVE:
-        num_coords = parse_reserve(in_fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
+        num_coords = parse_reserve(&in, MAX_RESERVATION_SIZE, &event_id, ranges);
 
         if (num_coords == 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
-        if (ems_reserve(event_id, num_coords, xs, ys)) fprintf(stderr, "Failed to reserve seats\n");
+        if (ems_reserve_ranges(event_id, num_coords, ranges)) fprintf(stderr, "Failed to reserve seats\n");
         break;
 
       case CMD_SHOW:
-        if (parse_show(in_fd, &event_id) != 0) {
+        if (parse_show(&in, &event_id) != 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
@@ -110,7 +152,7 @@ int main(int argc, char* argv[]) {
         break;
 
       case CMD_WAIT:
-        if (parse_wait(in_fd, &delay, NULL) == -1) {
+        if (parse_wait(&in, &delay, NULL) == -1) {
             fprintf(stderr, "Invalid command. See HELP for usage\n");
             continue;
         }
@@ -129,7 +171,9 @@ int main(int argc, char* argv[]) {
         printf(
             "Available commands:\n"
             "  CREATE <event_id> <num_rows> <num_columns>\n"
+            "    a range of events may be created at once with <first_id>-<last_id>\n"
             "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+            "    seats may also be given as (<x1>,<y1>)-(<x2>,<y2>) or (<x1>,<y1>):(<x2>,<y2>)\n"
             "  SHOW <event_id>\n"
             "  LIST\n"
             "  WAIT <delay_ms>\n"
@@ -141,10 +185,117 @@ int main(int argc, char* argv[]) {
         break;
 
       case EOC:
-        close(in_fd);
+        job_file_close(&jobs);
         close(out_fd);
-        ems_quit();
         return 0;
     }
   }
-}
\ No newline at end of file
+}
+
+/// Runs job files until none are left, each one in a session of its own.
+/// @return NULL.
+static void* job_thread(void* arg) {
+  (void)arg;
+
+  while (1) {
+    pthread_mutex_lock(&job_paths_mutex);
+    if (next_job_path == num_job_paths) {
+      pthread_mutex_unlock(&job_paths_mutex);
+      return NULL;
+    }
+    const char* jobs_path = job_paths[next_job_path++];
+    pthread_mutex_unlock(&job_paths_mutex);
+
+    if (ems_session_open() != 0) {
+      fprintf(stderr, "Failed to open a session for %s\n", jobs_path);
+      continue;
+    }
+    run_job_file(jobs_path);
+    ems_session_close();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  // Job files and directories come after the pipes, optionally preceded by -j <max threads>, -s and -i <dump name>
+  int first_path = 4;
+  unsigned long max_threads = MAX_JOB_THREADS;
+  int num_dumps = 0;
+  while (first_path < argc) {
+    if (strcmp(argv[first_path], "-j") == 0 && first_path + 1 < argc) {
+      char* endptr;
+      max_threads = strtoul(argv[first_path + 1], &endptr, 10);
+      if (*endptr != '\0' || max_threads < 1 || max_threads > UINT_MAX) {
+        fprintf(stderr, "Invalid max threads value\n");
+        return 1;
+      }
+      first_path += 2;
+    } else if (strcmp(argv[first_path], "-s") == 0) {
+      run_on_server = 1;
+      first_path++;
+    } else if (strcmp(argv[first_path], "-i") == 0 && first_path + 1 < argc) {
+      num_dumps++;
+      first_path += 2;
+    } else {
+      break;
+    }
+  }
+
+  if (argc <= first_path && num_dumps == 0) {
+    fprintf(stderr,
+            "Usage: %s <request pipe path> <response pipe path> <server pipe path> [-j <max threads>] [-s] "
+            "[-i <dump name>]... [<.jobs file or directory>...]\n",
+            argv[0]);
+    return 1;
+  }
+
+  for (int i = first_path; i < argc; i++) {
+    DIR* dir = opendir(argv[i]);
+    int result = dir != NULL ? add_job_dir(argv[i], dir) : add_job_path(argv[i]);
+    if (result != 0) {
+      return 1;
+    }
+  }
+
+  if (ems_setup(argv[1], argv[2], argv[3])) {
+    fprintf(stderr, "Failed to set up EMS\n");
+    return 1;
+  }
+
+  // Dumps are imported before any job runs, in the order they were given
+  for (int i = 4; i < first_path; i++) {
+    if (strcmp(argv[i], "-j") == 0) {
+      i++;
+    } else if (strcmp(argv[i], "-i") == 0 && ems_import(argv[++i]) != 0) {
+      fprintf(stderr, "Failed to import dump. Name: %s\n", argv[i]);
+    }
+  }
+
+  // Every thread drives its own session over the same connection
+  size_t num_threads = num_job_paths < max_threads ? num_job_paths : max_threads;
+  pthread_t* threads = malloc(sizeof(pthread_t) * (num_threads > 0 ? num_threads : 1));
+  if (threads == NULL) {
+    fprintf(stderr, "Failed to allocate memory for the job threads.\n");
+    ems_quit();
+    return 1;
+  }
+
+  size_t started = 0;
+  for (; started < num_threads; started++) {
+    if (pthread_create(&threads[started], NULL, &job_thread, NULL) != 0) {
+      fprintf(stderr, "Failed to create job thread %zu.\n", started);
+      break;
+    }
+  }
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  free(threads);
+  for (size_t i = 0; i < num_job_paths; i++) {
+    free(job_paths[i]);
+  }
+  free(job_paths);
+
+  ems_quit();
+  return started > 0 || num_threads == 0 ? 0 : 1;
+}
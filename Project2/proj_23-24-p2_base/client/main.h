@@ -1 +1,3 @@
 #include "common/constants.h"
+
+#define MAX_JOB_THREADS 8  // Job files run at the same time when -j is not given
@@ -1,216 +0,0 @@
-#include "parser.h"
-
-#include <limits.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-
-#include "common/constants.h"
-#include "common/io.h"
-
-static void cleanup(int fd) {
-  char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
-    ;
-}
-
-enum Command get_next(int fd) {
-  char buf[16];
-  if (read(fd, buf, 1) != 1) {
-    return EOC;
-  }
-
-  switch (buf[0]) {
-    case 'C':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
-        cleanup(fd);
-        return CMD_INVALID;
-      }
-
-      return CMD_CREATE;
-
-    case 'R':
-      if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
-        cleanup(fd);
-        return CMD_INVALID;
-      }
-
-      return CMD_RESERVE;
-
-    case 'S':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
-        cleanup(fd);
-        return CMD_INVALID;
-      }
-
-      return CMD_SHOW;
-
-    case 'L':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
-        cleanup(fd);
-        return CMD_INVALID;
-      }
-
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
-        return CMD_INVALID;
-      }
-
-      return CMD_LIST_EVENTS;
-
-    case 'W':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-        cleanup(fd);
-        return CMD_INVALID;
-      }
-
-      return CMD_WAIT;
-
-    case 'H':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
-        cleanup(fd);
-        return CMD_INVALID;
-      }
-
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
-        return CMD_INVALID;
-      }
-
-      return CMD_HELP;
-
-    case '#':
-      cleanup(fd);
-      return CMD_EMPTY;
-
-    case '\n':
-      return CMD_EMPTY;
-
-    default:
-      cleanup(fd);
-      return CMD_INVALID;
-  }
-}
-
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_cols) {
-  char ch;
-
-  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
-    return 1;
-  }
-
-  unsigned int u_num_rows;
-  if (parse_uint(fd, &u_num_rows, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
-    return 1;
-  }
-  *num_rows = (size_t)u_num_rows;
-
-  unsigned int u_num_cols;
-  if (parse_uint(fd, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
-    return 1;
-  }
-  *num_cols = (size_t)u_num_cols;
-
-  return 0;
-}
-
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
-  char ch;
-
-  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
-    return 0;
-  }
-
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
-    return 0;
-  }
-
-  size_t num_coords = 0;
-  while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
-      cleanup(fd);
-      return 0;
-    }
-
-    unsigned int x;
-    if (parse_uint(fd, &x, &ch) != 0 || ch != ',') {
-      cleanup(fd);
-      return 0;
-    }
-    xs[num_coords] = (size_t)x;
-
-    unsigned int y;
-    if (parse_uint(fd, &y, &ch) != 0 || ch != ')') {
-      cleanup(fd);
-      return 0;
-    }
-    ys[num_coords] = (size_t)y;
-
-    num_coords++;
-
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
-      cleanup(fd);
-      return 0;
-    }
-
-    if (ch == ']') {
-      break;
-    }
-  }
-
-  if (num_coords == max) {
-    cleanup(fd);
-    return 0;
-  }
-
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
-    return 0;
-  }
-
-  return num_coords;
-}
-
-int parse_show(int fd, unsigned int *event_id) {
-  char ch;
-
-  if (parse_uint(fd, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
-    return 1;
-  }
-
-  return 0;
-}
-
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
-  char ch;
-
-  if (parse_uint(fd, delay, &ch) != 0) {
-    cleanup(fd);
-    return -1;
-  }
-
-  if (ch == ' ') {
-    if (thread_id == NULL) {
-      cleanup(fd);
-      return 0;
-    }
-
-    if (parse_uint(fd, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-      cleanup(fd);
-      return -1;
-    }
-
-    return 1;
-  } else if (ch == '\n' || ch == '\0') {
-    return 0;
-  } else {
-    cleanup(fd);
-    return -1;
-  }
-}
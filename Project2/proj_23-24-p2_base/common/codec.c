@@ -0,0 +1,177 @@
+#include "codec.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+size_t varint_encode(uint64_t value, unsigned char *out) {
+  size_t i = 0;
+
+  while (value >= 0x80) {
+    out[i++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  out[i++] = (unsigned char)value;
+
+  return i;
+}
+
+size_t varint_decode(const unsigned char *in, size_t len, uint64_t *value) {
+  uint64_t result = 0;
+
+  for (size_t i = 0; i < len && i < VARINT_MAX_SIZE; i++) {
+    result |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+
+    if ((in[i] & 0x80) == 0) {
+      *value = result;
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+size_t rle_encode(const unsigned int *seats, size_t count, unsigned char *out, size_t capacity) {
+  unsigned char tmp[2 * VARINT_MAX_SIZE];
+  size_t written = 0;
+  size_t i = 0;
+
+  while (i < count) {
+    size_t run = 1;
+    while (i + run < count && seats[i + run] == seats[i]) {
+      run++;
+    }
+
+    size_t len = varint_encode(seats[i], tmp);
+    len += varint_encode(run, tmp + len);
+    if (written + len > capacity) {
+      return 0;
+    }
+
+    for (size_t j = 0; j < len; j++) {
+      out[written++] = tmp[j];
+    }
+    i += run;
+  }
+
+  return written;
+}
+
+int rle_decode(const unsigned char *in, size_t len, unsigned int *seats, size_t count) {
+  size_t pos = 0;
+  size_t filled = 0;
+
+  while (pos < len) {
+    uint64_t value, run;
+
+    size_t used = varint_decode(in + pos, len - pos, &value);
+    if (used == 0 || value > UINT_MAX) {
+      return 1;
+    }
+    pos += used;
+
+    used = varint_decode(in + pos, len - pos, &run);
+    if (used == 0 || run > count - filled) {
+      return 1;
+    }
+    pos += used;
+
+    for (uint64_t j = 0; j < run; j++) {
+      seats[filled++] = (unsigned int)value;
+    }
+  }
+
+  return filled != count;
+}
+
+static int compare_keys(const void *a, const void *b) {
+  uint64_t ka = *(const uint64_t *)a;
+  uint64_t kb = *(const uint64_t *)b;
+  return (ka > kb) - (ka < kb);
+}
+
+size_t seats_encode(size_t num_seats, const size_t *xs, const size_t *ys, unsigned char *out) {
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] > UINT32_MAX || ys[i] > UINT32_MAX) {
+      return SIZE_MAX;
+    }
+  }
+
+  uint64_t *keys = malloc(sizeof(uint64_t) * (num_seats > 0 ? num_seats : 1));
+  if (keys == NULL) {
+    return SIZE_MAX;
+  }
+
+  for (size_t i = 0; i < num_seats; i++) {
+    keys[i] = (uint64_t)xs[i] << 32 | (uint32_t)ys[i];
+  }
+  qsort(keys, num_seats, sizeof(uint64_t), compare_keys);
+
+  size_t written = 0;
+  uint64_t previous = 0;
+  for (size_t i = 0; i < num_seats; i++) {
+    written += varint_encode(keys[i] - previous, out + written);
+    previous = keys[i];
+  }
+
+  free(keys);
+  return written;
+}
+
+int seats_decode(const unsigned char *in, size_t len, size_t num_seats, size_t *xs, size_t *ys) {
+  size_t pos = 0;
+  uint64_t key = 0;
+
+  for (size_t i = 0; i < num_seats; i++) {
+    uint64_t delta;
+    size_t used = varint_decode(in + pos, len - pos, &delta);
+    // Keys are strictly increasing, so a zero delta after the first seat is a duplicate
+    if (used == 0 || (i > 0 && delta == 0) || delta > UINT64_MAX - key) {
+      return 1;
+    }
+    pos += used;
+    key += delta;
+
+    xs[i] = (size_t)(key >> 32);
+    ys[i] = (size_t)(key & UINT32_MAX);
+    if (xs[i] == 0 || ys[i] == 0) {
+      return 1;
+    }
+  }
+
+  return pos != len;
+}
+
+size_t ranges_encode(size_t num_ranges, const struct SeatRange *ranges, unsigned char *out) {
+  size_t written = 0;
+
+  for (size_t i = 0; i < num_ranges; i++) {
+    written += varint_encode(ranges[i].x1, out + written);
+    written += varint_encode(ranges[i].y1, out + written);
+    written += varint_encode(ranges[i].x2, out + written);
+    written += varint_encode(ranges[i].y2, out + written);
+  }
+
+  return written;
+}
+
+int ranges_decode(const unsigned char *in, size_t len, size_t num_ranges, struct SeatRange *ranges) {
+  size_t pos = 0;
+
+  for (size_t i = 0; i < num_ranges; i++) {
+    uint64_t values[4];
+    for (size_t j = 0; j < 4; j++) {
+      size_t used = varint_decode(in + pos, len - pos, &values[j]);
+      if (used == 0 || values[j] > SIZE_MAX) {
+        return 1;
+      }
+      pos += used;
+    }
+
+    ranges[i].x1 = (size_t)values[0];
+    ranges[i].y1 = (size_t)values[1];
+    ranges[i].x2 = (size_t)values[2];
+    ranges[i].y2 = (size_t)values[3];
+  }
+
+  return pos != len;
+}
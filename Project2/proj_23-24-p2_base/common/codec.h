@@ -0,0 +1,90 @@
+#ifndef COMMON_CODEC_H
+#define COMMON_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Maximum number of bytes a varint-encoded 64-bit value can take.
+#define VARINT_MAX_SIZE 10
+
+/// Encodes an unsigned integer as a little-endian base-128 varint.
+/// @param value The value to encode.
+/// @param out Buffer to write to, with room for at least VARINT_MAX_SIZE bytes.
+/// @return Number of bytes written.
+size_t varint_encode(uint64_t value, unsigned char *out);
+
+/// Decodes a varint written by varint_encode.
+/// @param in Buffer to read from.
+/// @param len Number of bytes available in the buffer.
+/// @param value Pointer to the variable to store the value in.
+/// @return Number of bytes consumed, 0 if the input is truncated or malformed.
+size_t varint_decode(const unsigned char *in, size_t len, uint64_t *value);
+
+/// Run-length encodes a seat grid as (varint reservation id, varint run length) pairs.
+/// @param seats Array of seats to encode.
+/// @param count Number of seats in the array.
+/// @param out Buffer to write the encoded seats to.
+/// @param capacity Size of the output buffer.
+/// @return Number of bytes written, 0 if the encoding does not fit in the buffer.
+size_t rle_encode(const unsigned int *seats, size_t count, unsigned char *out, size_t capacity);
+
+/// Decodes a seat grid written by rle_encode.
+/// @param in Buffer to read from.
+/// @param len Number of bytes in the buffer.
+/// @param seats Array to store the seats in.
+/// @param count Number of seats expected.
+/// @return 0 if exactly count seats were decoded, 1 otherwise.
+int rle_decode(const unsigned char *in, size_t len, unsigned int *seats, size_t count);
+
+/// Event addressed by a request, by id or straight by the handle the server gave out for it.
+struct EventRef {
+  unsigned int id;          /// Id of the event.
+  unsigned int slot;        /// Slot of the event in the server event table.
+  unsigned int generation;  /// Generation of the slot when the handle was given out, 0 to look the event up by id.
+};
+
+/// Rectangle of seats, with both corners included.
+struct SeatRange {
+  size_t x1;  /// First row.
+  size_t y1;  /// First column.
+  size_t x2;  /// Last row.
+  size_t y2;  /// Last column.
+};
+
+/// Maximum number of bytes a range takes once encoded.
+#define SEAT_RANGE_MAX_SIZE (4 * VARINT_MAX_SIZE)
+
+/// Encodes a list of ranges as four varints each.
+/// @param num_ranges Number of ranges to encode.
+/// @param ranges Array of ranges to encode.
+/// @param out Buffer to write to, with room for at least num_ranges * SEAT_RANGE_MAX_SIZE bytes.
+/// @return Number of bytes written.
+size_t ranges_encode(size_t num_ranges, const struct SeatRange *ranges, unsigned char *out);
+
+/// Decodes a list of ranges written by ranges_encode.
+/// @param in Buffer to read from.
+/// @param len Number of bytes in the buffer.
+/// @param num_ranges Number of ranges expected.
+/// @param ranges Array to store the ranges in.
+/// @return 0 if exactly num_ranges ranges were decoded, 1 otherwise.
+int ranges_decode(const unsigned char *in, size_t len, size_t num_ranges, struct SeatRange *ranges);
+
+/// Encodes a list of seats as sorted, delta-varint-encoded (row << 32 | col) keys.
+/// @param num_seats Number of seats to encode.
+/// @param xs Array of rows of the seats, each at most UINT32_MAX.
+/// @param ys Array of columns of the seats, each at most UINT32_MAX.
+/// @param out Buffer to write to, with room for at least num_seats * VARINT_MAX_SIZE bytes.
+/// @return Number of bytes written, SIZE_MAX if a coordinate does not fit in a key or the keys could not be sorted.
+size_t seats_encode(size_t num_seats, const size_t *xs, const size_t *ys, unsigned char *out);
+
+/// Decodes a list of seats written by seats_encode.
+/// @note Rejects duplicate seats and seats in row or column 0.
+/// @param in Buffer to read from.
+/// @param len Number of bytes in the buffer.
+/// @param num_seats Number of seats expected.
+/// @param xs Array to store the rows of the seats in.
+/// @param ys Array to store the columns of the seats in.
+/// @return 0 if exactly num_seats valid seats were decoded, 1 otherwise.
+int seats_decode(const unsigned char *in, size_t len, size_t num_seats, size_t *xs, size_t *ys);
+
+#endif  // COMMON_CODEC_H
@@ -1,5 +1,10 @@
-#define MAX_RESERVATION_SIZE 256
+#define MAX_RESERVATION_SIZE 256  // Seats or ranges in a single RESERVE command
+#define EMS_RANGE_CHUNK_SIZE 64   // Ranges sent per chunk of a RESERVE_RANGES request
+#define EMS_JOBS_CHUNK_SIZE 65536  // Script or output bytes sent per chunk of a RUN_JOBS request
+#define EMS_LIST_PAGE_SIZE 16384  // Event ids sent per page of a LIST response
 #define STATE_ACCESS_DELAY_US 500000  // 500ms
+#define EMS_MULTI_MAX_EVENTS 16  // Events in a single RESERVE_MULTI request
+#define EMS_SHOW_MANY_MAX_EVENTS 256  // Events in a single SHOW_MANY request
 #define MAX_JOB_FILE_NAME_SIZE 256
 #define MAX_SESSION_COUNT 2
 
@@ -9,8 +14,42 @@
 #define EMS_RESERVE_CODE 4
 #define EMS_SHOW_CODE 5
 #define EMS_LIST_CODE 6
+#define EMS_SHOW_SINCE_CODE 7
+#define EMS_RESERVE_RANGES_CODE 8
+#define EMS_RUN_JOBS_CODE 9
+#define EMS_SUBSCRIBE_CODE 10
+#define EMS_NOTIFY_CODE 11  // Pushed by the server, never sent by clients
+#define EMS_OPEN_EVENT_CODE 12
+#define EMS_RESERVE_MULTI_CODE 13
+#define EMS_STATS_CODE 14
+#define EMS_RESERVE_BEST_CODE 15
+#define EMS_GET_RESERVATION_CODE 16
+#define EMS_CANCEL_CODE 17
+#define EMS_SHOW_MANY_CODE 18
+#define EMS_CREATE_MANY_CODE 19
+#define EMS_LIST_RANGE_CODE 20
+#define EMS_CREATE_TEMPLATE_CODE 21
+#define EMS_CREATE_FROM_TEMPLATE_CODE 22
+#define EMS_IMPORT_CODE 23
 
 #define MAX_PIPENAME_SIZE 40
+#define MAX_FRAME_SIZE (64 * 1024 * 1024)  // Largest request payload the server accepts
+
+// Optional features a client may request at setup (bitmask)
+#define EMS_FEATURE_SHOW_RLE 1
+#define EMS_SERVER_FEATURES (EMS_FEATURE_SHOW_RLE)
+
+#define EMS_SHOW_ENCODING_RAW 0
+#define EMS_SHOW_ENCODING_RLE 1
+#define EMS_SHOW_RLE_THRESHOLD 4096  // Grids smaller than this (in bytes) are always sent raw
+
+// Kind of the SHOW_SINCE response
+#define EMS_SHOW_FULL 0
+#define EMS_SHOW_DELTA 1
+
+// Kind of a pushed notification
+#define EMS_NOTIFY_CHANGES 0
+#define EMS_NOTIFY_DROPPED 1  // Changes were dropped because the client fell behind, it must SHOW to resync
 
 #define FAIL_MSG 1
 #define SUCCESS_MSG 0
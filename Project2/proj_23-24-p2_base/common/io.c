@@ -39,41 +39,240 @@ int parse_uint(int fd, unsigned int *value, char *next) {
   return 0;
 }
 
-int print_uint(int fd, unsigned int value) {
-  char buffer[16];
-  size_t i = 16;
+// Every number from 00 to 99, so digits can be formatted two at a time
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/// Formats an unsigned integer in decimal, right-aligned before the given position.
+/// @param value The value to format.
+/// @param end Position right after the last digit, with room for UINT_MAX_DIGITS bytes before it.
+/// @return Number of digits written.
+static size_t format_uint(unsigned int value, char *end) {
+  char *ptr = end;
 
-  for (; value > 0; value /= 10) {
-    buffer[--i] = '0' + (char)(value % 10);
+  while (value >= 100) {
+    unsigned int pair = (value % 100) * 2;
+    value /= 100;
+    *--ptr = digit_pairs[pair + 1];
+    *--ptr = digit_pairs[pair];
   }
 
-  if (i == 16) {
-    buffer[--i] = '0';
+  if (value >= 10) {
+    *--ptr = digit_pairs[value * 2 + 1];
+    *--ptr = digit_pairs[value * 2];
+  } else {
+    *--ptr = (char)('0' + value);
   }
 
-  while (i < 16) {
-    ssize_t written = write(fd, buffer + i, 16 - i);
+  return (size_t)(end - ptr);
+}
+
+int print_uint(int fd, unsigned int value) {
+  char buffer[UINT_MAX_DIGITS];
+  size_t len = format_uint(value, buffer + UINT_MAX_DIGITS);
+
+  return write_full(fd, buffer + UINT_MAX_DIGITS - len, len);
+}
+
+int print_str(int fd, const char *str) {
+  size_t len = strlen(str);
+  while (len > 0) {
+    ssize_t written = write(fd, str, len);
     if (written == -1) {
       return 1;
     }
 
-    i += (size_t)written;
+    str += (size_t)written;
+    len -= (size_t)written;
   }
 
   return 0;
 }
 
-int print_str(int fd, const char *str) {
-  size_t len = strlen(str);
+int read_full(int fd, void *buf, size_t len) {
+  char *ptr = buf;
   while (len > 0) {
-    ssize_t written = write(fd, str, len);
+    ssize_t read_bytes = read(fd, ptr, len);
+    if (read_bytes <= 0) {
+      return 1;
+    }
+
+    ptr += (size_t)read_bytes;
+    len -= (size_t)read_bytes;
+  }
+
+  return 0;
+}
+
+int write_full(int fd, const void *buf, size_t len) {
+  const char *ptr = buf;
+  while (len > 0) {
+    ssize_t written = write(fd, ptr, len);
     if (written == -1) {
       return 1;
     }
 
-    str += (size_t)written;
+    ptr += (size_t)written;
     len -= (size_t)written;
   }
 
   return 0;
 }
+
+void *buffer_extend(struct Buffer *buffer, size_t len) {
+  if (buffer->size + len > buffer->capacity) {
+    size_t capacity = buffer->capacity > 0 ? buffer->capacity : 64;
+    while (capacity < buffer->size + len) {
+      capacity *= 2;
+    }
+
+    char *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+      return NULL;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+  }
+
+  void *added = buffer->data + buffer->size;
+  buffer->size += len;
+  return added;
+}
+
+int buffer_append(struct Buffer *buffer, const void *data, size_t len) {
+  void *added = buffer_extend(buffer, len);
+  if (added == NULL) {
+    return 1;
+  }
+
+  memcpy(added, data, len);
+  return 0;
+}
+
+void buffer_free(struct Buffer *buffer) {
+  free(buffer->data);
+  buffer->data = NULL;
+  buffer->size = 0;
+  buffer->capacity = 0;
+}
+
+int buffer_append_uint(struct Buffer *buffer, unsigned int value) {
+  char digits[UINT_MAX_DIGITS];
+  size_t len = format_uint(value, digits + UINT_MAX_DIGITS);
+
+  return buffer_append(buffer, digits + UINT_MAX_DIGITS - len, len);
+}
+
+const void *reader_take(struct Reader *reader, size_t len) {
+  if (len > reader->size - reader->pos) {
+    return NULL;
+  }
+
+  const void *taken = reader->data + reader->pos;
+  reader->pos += len;
+  return taken;
+}
+
+int reader_read(struct Reader *reader, void *out, size_t len) {
+  const void *taken = reader_take(reader, len);
+  if (taken == NULL) {
+    return 1;
+  }
+
+  memcpy(out, taken, len);
+  return 0;
+}
+
+int write_frame(int fd, char op, int session_id, unsigned int request_id, const void *payload, size_t size) {
+  char frame[4096];
+  size_t offset = 0;
+  memcpy(frame + offset, &op, sizeof(char));
+  offset += sizeof(char);
+  memcpy(frame + offset, &session_id, sizeof(int));
+  offset += sizeof(int);
+  memcpy(frame + offset, &request_id, sizeof(unsigned int));
+  offset += sizeof(unsigned int);
+  memcpy(frame + offset, &size, sizeof(size_t));
+
+  // Small frames go out in a single write
+  if (size <= sizeof(frame) - FRAME_HEADER_SIZE) {
+    if (size > 0) {
+      memcpy(frame + FRAME_HEADER_SIZE, payload, size);
+    }
+    return write_full(fd, frame, FRAME_HEADER_SIZE + size);
+  }
+
+  return write_full(fd, frame, FRAME_HEADER_SIZE) || write_full(fd, payload, size);
+}
+
+int read_frame_header(int fd, char *op, int *session_id, unsigned int *request_id, size_t *size) {
+  char header[FRAME_HEADER_SIZE];
+  if (read_full(fd, header, FRAME_HEADER_SIZE) != 0) {
+    return 1;
+  }
+
+  size_t offset = 0;
+  memcpy(op, header + offset, sizeof(char));
+  offset += sizeof(char);
+  memcpy(session_id, header + offset, sizeof(int));
+  offset += sizeof(int);
+  memcpy(request_id, header + offset, sizeof(unsigned int));
+  offset += sizeof(unsigned int);
+  memcpy(size, header + offset, sizeof(size_t));
+  return 0;
+}
+
+void writer_init(struct Writer *writer, int fd) {
+  writer->fd = fd;
+  writer->size = 0;
+  writer->failed = 0;
+}
+
+int writer_flush(struct Writer *writer) {
+  if (!writer->failed && writer->size > 0 && write_full(writer->fd, writer->data, writer->size) != 0) {
+    writer->failed = 1;
+  }
+
+  writer->size = 0;
+  return writer->failed;
+}
+
+int writer_uint(struct Writer *writer, unsigned int value) {
+  if (writer->size + UINT_MAX_DIGITS > WRITER_CAPACITY && writer_flush(writer) != 0) {
+    return 1;
+  }
+
+  char digits[UINT_MAX_DIGITS];
+  size_t len = format_uint(value, digits + UINT_MAX_DIGITS);
+  memcpy(writer->data + writer->size, digits + UINT_MAX_DIGITS - len, len);
+  writer->size += len;
+  return 0;
+}
+
+int writer_char(struct Writer *writer, char c) {
+  if (writer->size == WRITER_CAPACITY && writer_flush(writer) != 0) {
+    return 1;
+  }
+
+  writer->data[writer->size++] = c;
+  return 0;
+}
+
+int writer_str(struct Writer *writer, const char *str) {
+  size_t len = strlen(str);
+  while (len > 0) {
+    if (writer->size == WRITER_CAPACITY && writer_flush(writer) != 0) {
+      return 1;
+    }
+
+    size_t chunk = WRITER_CAPACITY - writer->size < len ? WRITER_CAPACITY - writer->size : len;
+    memcpy(writer->data + writer->size, str, chunk);
+    writer->size += chunk;
+    str += chunk;
+    len -= chunk;
+  }
+
+  return 0;
+}
@@ -1,6 +1,8 @@
 #ifndef COMMON_IO_H
 #define COMMON_IO_H
 
+#include <stddef.h>
+
 /// Parses an unsigned integer from the given file descriptor.
 /// @param fd The file descriptor to read from.
 /// @param value Pointer to the variable to store the value in.
@@ -8,6 +10,9 @@
 /// @return 0 if the integer was read successfully, 1 otherwise.
 int parse_uint(int fd, unsigned int *value, char *next);
 
+/// Maximum number of decimal digits of an unsigned int.
+#define UINT_MAX_DIGITS 10
+
 /// Prints an unsigned integer to the given file descriptor.
 /// @param fd The file descriptor to write to.
 /// @param value The value to write.
@@ -20,4 +25,130 @@ int print_uint(int fd, unsigned int value);
 /// @return 0 if the string was written successfully, 1 otherwise.
 int print_str(int fd, const char *str);
 
+/// Reads exactly the given number of bytes from the given file descriptor.
+/// @param fd The file descriptor to read from.
+/// @param buf Buffer to store the bytes in.
+/// @param len Number of bytes to read.
+/// @return 0 if all the bytes were read, 1 on error or end of file.
+int read_full(int fd, void *buf, size_t len);
+
+/// Writes exactly the given number of bytes to the given file descriptor.
+/// @param fd The file descriptor to write to.
+/// @param buf Buffer with the bytes to write.
+/// @param len Number of bytes to write.
+/// @return 0 if all the bytes were written, 1 otherwise.
+int write_full(int fd, const void *buf, size_t len);
+
+/// Growable array of bytes, used to build a message before sending it.
+struct Buffer {
+  char *data;
+  size_t size;
+  size_t capacity;
+};
+
+/// Makes room for more bytes at the end of a buffer.
+/// @param buffer The buffer to grow.
+/// @param len Number of bytes to add.
+/// @return Pointer to the added bytes, NULL if the buffer could not be grown.
+void *buffer_extend(struct Buffer *buffer, size_t len);
+
+/// Appends bytes to the end of a buffer.
+/// @param buffer The buffer to append to.
+/// @param data The bytes to append.
+/// @param len Number of bytes to append.
+/// @return 0 if the bytes were appended successfully, 1 otherwise.
+int buffer_append(struct Buffer *buffer, const void *data, size_t len);
+
+/// Appends an unsigned integer in decimal to the end of a buffer.
+/// @param buffer The buffer to append to.
+/// @param value The value to append.
+/// @return 0 if the integer was appended successfully, 1 otherwise.
+int buffer_append_uint(struct Buffer *buffer, unsigned int value);
+
+/// Releases the memory held by a buffer and empties it.
+/// @param buffer The buffer to free.
+void buffer_free(struct Buffer *buffer);
+
+/// Cursor over a message that was received whole.
+struct Reader {
+  const char *data;
+  size_t size;
+  size_t pos;
+};
+
+/// Takes the next bytes of a message without copying them.
+/// @param reader The reader to take from.
+/// @param len Number of bytes to take.
+/// @return Pointer to the bytes, NULL if fewer than len bytes are left.
+const void *reader_take(struct Reader *reader, size_t len);
+
+/// Copies the next bytes of a message.
+/// @param reader The reader to read from.
+/// @param out Buffer to store the bytes in.
+/// @param len Number of bytes to read.
+/// @return 0 if the bytes were read successfully, 1 if fewer than len bytes are left.
+int reader_read(struct Reader *reader, void *out, size_t len);
+
+/// Size of a frame header on the wire: op code, session id, request id and payload size.
+#define FRAME_HEADER_SIZE (sizeof(char) + sizeof(int) + sizeof(unsigned int) + sizeof(size_t))
+
+/// Writes a whole frame to the given file descriptor.
+/// @note Callers sharing the file descriptor must serialize their calls.
+/// @param fd The file descriptor to write to.
+/// @param op Op code of the frame.
+/// @param session_id Logical session the frame belongs to.
+/// @param request_id Request the frame belongs to, echoed back in its response.
+/// @param payload Payload of the frame.
+/// @param size Size of the payload.
+/// @return 0 if the frame was written successfully, 1 otherwise.
+int write_frame(int fd, char op, int session_id, unsigned int request_id, const void *payload, size_t size);
+
+/// Reads a frame header from the given file descriptor.
+/// @param fd The file descriptor to read from.
+/// @param op Pointer to the variable to store the op code in.
+/// @param session_id Pointer to the variable to store the session id in.
+/// @param request_id Pointer to the variable to store the request id in.
+/// @param size Pointer to the variable to store the payload size in.
+/// @return 0 if the header was read successfully, 1 on error or end of file.
+int read_frame_header(int fd, char *op, int *session_id, unsigned int *request_id, size_t *size);
+
+/// Capacity of a Writer, written out in one go when full.
+#define WRITER_CAPACITY 65536
+
+/// Output buffer that collects text and writes it to a file descriptor in large chunks.
+struct Writer {
+  int fd;
+  char data[WRITER_CAPACITY];
+  size_t size;
+  int failed;  /// Whether a write failed, after which the output is dropped.
+};
+
+/// Starts an empty writer for the given file descriptor.
+/// @param writer The writer to initialize.
+/// @param fd The file descriptor to write to.
+void writer_init(struct Writer *writer, int fd);
+
+/// Writes out everything buffered so far.
+/// @param writer The writer to flush.
+/// @return 0 if every write so far succeeded, 1 otherwise.
+int writer_flush(struct Writer *writer);
+
+/// Appends an unsigned integer in decimal.
+/// @param writer The writer to append to.
+/// @param value The value to append.
+/// @return 0 if the integer was appended successfully, 1 otherwise.
+int writer_uint(struct Writer *writer, unsigned int value);
+
+/// Appends a single character.
+/// @param writer The writer to append to.
+/// @param c The character to append.
+/// @return 0 if the character was appended successfully, 1 otherwise.
+int writer_char(struct Writer *writer, char c);
+
+/// Appends a string.
+/// @param writer The writer to append to.
+/// @param str The string to append.
+/// @return 0 if the string was appended successfully, 1 otherwise.
+int writer_str(struct Writer *writer, const char *str);
+
 #endif  // COMMON_IO_H
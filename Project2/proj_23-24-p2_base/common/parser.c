@@ -0,0 +1,402 @@
+#include "parser.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common/constants.h"
+#include "common/io.h"
+
+int job_file_open(const char *path, struct JobFile *file) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return 1;
+  }
+
+  file->data = NULL;
+  file->size = 0;
+  file->mapped = 0;
+
+  // Regular files are mapped whole, anything else (pipes, devices) is read into memory
+  if (S_ISREG(st.st_mode)) {
+    file->size = (size_t)st.st_size;
+    if (file->size > 0) {
+      void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        file->data = data;
+        file->mapped = 1;
+        close(fd);
+        return 0;
+      }
+    }
+    if (file->size == 0) {
+      close(fd);
+      return 0;
+    }
+  }
+
+  size_t capacity = file->size > 0 ? file->size : 4096;
+  char *data = malloc(capacity);
+  size_t size = 0;
+  while (data != NULL) {
+    if (size == capacity) {
+      char *grown = realloc(data, 2 * capacity);
+      if (grown == NULL) {
+        break;
+      }
+      data = grown;
+      capacity *= 2;
+    }
+
+    ssize_t read_bytes = read(fd, data + size, capacity - size);
+    if (read_bytes <= 0) {
+      close(fd);
+      if (read_bytes < 0) {
+        free(data);
+        return 1;
+      }
+      file->data = data;
+      file->size = size;
+      return 0;
+    }
+    size += (size_t)read_bytes;
+  }
+
+  free(data);
+  close(fd);
+  return 1;
+}
+
+void job_file_close(struct JobFile *file) {
+  if (file->mapped) {
+    munmap((void *)file->data, file->size);
+  } else {
+    free((void *)file->data);
+  }
+
+  file->data = NULL;
+  file->size = 0;
+  file->mapped = 0;
+}
+
+/// Takes the next character of a span.
+/// @param in The span to read from.
+/// @param ch Pointer to the variable to store the character in.
+/// @return 1 if a character was taken, 0 at the end of the span.
+static int next_char(struct Span *in, char *ch) {
+  if (in->pos == in->end) {
+    return 0;
+  }
+
+  *ch = *in->pos++;
+  return 1;
+}
+
+/// Takes the given text from the start of a span, if it is there.
+/// @param in The span to read from.
+/// @param text The text to match.
+/// @param len Length of the text.
+/// @return 1 if the text was taken, 0 otherwise.
+static int take_text(struct Span *in, const char *text, size_t len) {
+  if ((size_t)(in->end - in->pos) < len || memcmp(in->pos, text, len) != 0) {
+    return 0;
+  }
+
+  in->pos += len;
+  return 1;
+}
+
+/// Parses an unsigned integer, taking the character that ends it as well.
+/// @param in The span to read from.
+/// @param value Pointer to the variable to store the value in.
+/// @param next Pointer to the variable to store the next character in, '\0' at the end of the span.
+/// @return 0 if the integer was parsed successfully, 1 otherwise.
+static int parse_uint_span(struct Span *in, unsigned int *value, char *next) {
+  const char *start = in->pos;
+  unsigned long ul = 0;
+
+  while (in->pos != in->end && *in->pos >= '0' && *in->pos <= '9') {
+    ul = ul * 10 + (unsigned long)(*in->pos++ - '0');
+    if (ul > UINT_MAX) {
+      return 1;
+    }
+  }
+
+  int empty = in->pos == start;
+  if (!next_char(in, next)) {
+    *next = '\0';
+  }
+
+  if (empty) {
+    return 1;
+  }
+
+  *value = (unsigned int)ul;
+  return 0;
+}
+
+/// Skips the rest of the current line.
+/// @param in The span to read from.
+static void cleanup(struct Span *in) {
+  const char *newline = memchr(in->pos, '\n', (size_t)(in->end - in->pos));
+  in->pos = newline != NULL ? newline + 1 : in->end;
+}
+
+/// Takes the end of a line with no arguments: a newline or the end of the span.
+/// @param in The span to read from.
+/// @return 1 if the line ended there, 0 otherwise.
+static int take_end_of_line(struct Span *in) {
+  char ch;
+  return !next_char(in, &ch) || ch == '\n';
+}
+
+enum Command get_next(struct Span *in) {
+  if (in->pos == in->end) {
+    return EOC;
+  }
+
+  switch (*in->pos) {
+    case 'C':
+      if (!take_text(in, "CREATE ", 7)) {
+        cleanup(in);
+        return CMD_INVALID;
+      }
+
+      return CMD_CREATE;
+
+    case 'R':
+      if (!take_text(in, "RESERVE ", 8)) {
+        cleanup(in);
+        return CMD_INVALID;
+      }
+
+      return CMD_RESERVE;
+
+    case 'S':
+      if (!take_text(in, "SHOW ", 5)) {
+        cleanup(in);
+        return CMD_INVALID;
+      }
+
+      return CMD_SHOW;
+
+    case 'L':
+      if (!take_text(in, "LIST", 4) || !take_end_of_line(in)) {
+        cleanup(in);
+        return CMD_INVALID;
+      }
+
+      return CMD_LIST_EVENTS;
+
+    case 'W':
+      if (!take_text(in, "WAIT ", 5)) {
+        cleanup(in);
+        return CMD_INVALID;
+      }
+
+      return CMD_WAIT;
+
+    case 'H':
+      if (!take_text(in, "HELP", 4) || !take_end_of_line(in)) {
+        cleanup(in);
+        return CMD_INVALID;
+      }
+
+      return CMD_HELP;
+
+    case '#':
+      cleanup(in);
+      return CMD_EMPTY;
+
+    case '\n':
+      in->pos++;
+      return CMD_EMPTY;
+
+    default:
+      cleanup(in);
+      return CMD_INVALID;
+  }
+}
+
+int parse_create(struct Span *in, unsigned int *event_id, unsigned int *last_event_id, size_t *num_rows,
+                 size_t *num_cols) {
+  char ch;
+
+  if (parse_uint_span(in, event_id, &ch) != 0 || (ch != ' ' && ch != '-')) {
+    cleanup(in);
+    return 1;
+  }
+
+  *last_event_id = *event_id;
+  if (ch == '-' && (parse_uint_span(in, last_event_id, &ch) != 0 || ch != ' ' || *last_event_id < *event_id)) {
+    cleanup(in);
+    return 1;
+  }
+
+  unsigned int u_num_rows;
+  if (parse_uint_span(in, &u_num_rows, &ch) != 0 || ch != ' ') {
+    cleanup(in);
+    return 1;
+  }
+  *num_rows = (size_t)u_num_rows;
+
+  unsigned int u_num_cols;
+  if (parse_uint_span(in, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(in);
+    return 1;
+  }
+  *num_cols = (size_t)u_num_cols;
+
+  return 0;
+}
+
+/// Parses a seat of the form (<x>,<y>).
+/// @param in The span to read from.
+/// @param x Pointer to the variable to store the row in.
+/// @param y Pointer to the variable to store the column in.
+/// @return 0 if the seat was parsed successfully, 1 otherwise.
+static int parse_seat(struct Span *in, size_t *x, size_t *y) {
+  char ch;
+
+  if (!next_char(in, &ch) || ch != '(') {
+    return 1;
+  }
+
+  unsigned int u_x;
+  if (parse_uint_span(in, &u_x, &ch) != 0 || ch != ',') {
+    return 1;
+  }
+  *x = (size_t)u_x;
+
+  unsigned int u_y;
+  if (parse_uint_span(in, &u_y, &ch) != 0 || ch != ')') {
+    return 1;
+  }
+  *y = (size_t)u_y;
+
+  return 0;
+}
+
+size_t parse_reserve(struct Span *in, size_t max, unsigned int *event_id, struct SeatRange *ranges) {
+  char ch;
+
+  if (parse_uint_span(in, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(in);
+    return 0;
+  }
+
+  if (!next_char(in, &ch) || ch != '[') {
+    cleanup(in);
+    return 0;
+  }
+
+  size_t num_ranges = 0;
+  while (num_ranges < max) {
+    struct SeatRange *range = &ranges[num_ranges];
+    if (parse_seat(in, &range->x1, &range->y1) != 0 || !next_char(in, &ch)) {
+      cleanup(in);
+      return 0;
+    }
+
+    if (ch == '-' || ch == ':') {
+      char kind = ch;
+      if (parse_seat(in, &range->x2, &range->y2) != 0 || !next_char(in, &ch)) {
+        cleanup(in);
+        return 0;
+      }
+
+      // A '-' range must stay within a single row or column
+      if (kind == '-' && range->x1 != range->x2 && range->y1 != range->y2) {
+        cleanup(in);
+        return 0;
+      }
+    } else {
+      range->x2 = range->x1;
+      range->y2 = range->y1;
+    }
+
+    if (range->x1 > range->x2) {
+      size_t tmp = range->x1;
+      range->x1 = range->x2;
+      range->x2 = tmp;
+    }
+    if (range->y1 > range->y2) {
+      size_t tmp = range->y1;
+      range->y1 = range->y2;
+      range->y2 = tmp;
+    }
+
+    num_ranges++;
+
+    if (ch != ' ' && ch != ']') {
+      cleanup(in);
+      return 0;
+    }
+
+    if (ch == ']') {
+      break;
+    }
+  }
+
+  if (num_ranges == max) {
+    cleanup(in);
+    return 0;
+  }
+
+  if (!take_end_of_line(in)) {
+    cleanup(in);
+    return 0;
+  }
+
+  return num_ranges;
+}
+
+int parse_show(struct Span *in, unsigned int *event_id) {
+  char ch;
+
+  if (parse_uint_span(in, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(in);
+    return 1;
+  }
+
+  return 0;
+}
+
+int parse_wait(struct Span *in, unsigned int *delay, unsigned int *thread_id) {
+  char ch;
+
+  if (parse_uint_span(in, delay, &ch) != 0) {
+    cleanup(in);
+    return -1;
+  }
+
+  if (ch == ' ') {
+    if (thread_id == NULL) {
+      cleanup(in);
+      return 0;
+    }
+
+    if (parse_uint_span(in, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+      cleanup(in);
+      return -1;
+    }
+
+    return 1;
+  } else if (ch == '\n' || ch == '\0') {
+    return 0;
+  } else {
+    cleanup(in);
+    return -1;
+  }
+}
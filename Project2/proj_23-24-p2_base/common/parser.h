@@ -0,0 +1,82 @@
+#ifndef COMMON_PARSER_H
+#define COMMON_PARSER_H
+
+#include <stddef.h>
+
+#include "common/codec.h"
+
+enum Command {
+  CMD_CREATE,
+  CMD_RESERVE,
+  CMD_SHOW,
+  CMD_LIST_EVENTS,
+  CMD_WAIT,
+  CMD_HELP,
+  CMD_EMPTY,
+  CMD_INVALID,
+  EOC  // End of commands
+};
+
+/// Contents of a .jobs file, held in memory while its commands are parsed.
+struct JobFile {
+  const char *data;
+  size_t size;
+  int mapped;  /// Whether data is mapped from the file rather than allocated.
+};
+
+/// Cursor over commands in memory, pointing straight into a JobFile.
+struct Span {
+  const char *pos;  /// Next character to parse.
+  const char *end;  /// One past the last character.
+};
+
+/// Loads a .jobs file into memory, mapping it when it is a regular file.
+/// @param path Path of the file.
+/// @param file Pointer to the variable to store the contents in.
+/// @return 0 if the file was loaded successfully, 1 otherwise.
+int job_file_open(const char *path, struct JobFile *file);
+
+/// Releases the contents of a .jobs file.
+/// @param file The file to release.
+void job_file_close(struct JobFile *file);
+
+/// Reads a line and returns the corresponding command.
+/// @param in Span to read from.
+/// @return The command read.
+enum Command get_next(struct Span *in);
+
+/// Parses a CREATE command.
+/// @note A range of events <first_id>-<last_id> may be given instead of a single event ID.
+/// @param in Span to read from.
+/// @param event_id Pointer to the variable to store the event ID, or the first of the range, in.
+/// @param last_event_id Pointer to the variable to store the last event ID of the range in, event_id if no range.
+/// @param num_rows Pointer to the variable to store the number of rows in.
+/// @param num_cols Pointer to the variable to store the number of columns in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_create(struct Span *in, unsigned int *event_id, unsigned int *last_event_id, size_t *num_rows,
+                 size_t *num_cols);
+
+/// Parses a RESERVE command.
+/// @note Each entry is a seat (<x>,<y>), a line of seats along a row or column (<x1>,<y1>)-(<x2>,<y2>),
+/// or a rectangle of seats (<x1>,<y1>):(<x2>,<y2>). A single seat is stored as a range with equal corners.
+/// @param in Span to read from.
+/// @param max Maximum number of entries to read.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @param ranges Pointer to the array to store the seat ranges in.
+/// @return Number of ranges read. 0 on failure.
+size_t parse_reserve(struct Span *in, size_t max, unsigned int *event_id, struct SeatRange *ranges);
+
+/// Parses a SHOW command.
+/// @param in Span to read from.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_show(struct Span *in, unsigned int *event_id);
+
+/// Parses a WAIT command.
+/// @param in Span to read from.
+/// @param delay Pointer to the variable to store the wait delay in.
+/// @param thread_id Pointer to the variable to store the thread ID in. May not be set.
+/// @return 0 if no thread was specified, 1 if a thread was specified, -1 on error.
+int parse_wait(struct Span *in, unsigned int *delay, unsigned int *thread_id);
+
+#endif  // COMMON_PARSER_H
@@ -2,27 +2,93 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   if (!list) return NULL;
-  if (pthread_rwlock_init(&list->rwl, NULL) != 0) {
+  list->index = calloc(1, sizeof(struct IndexNode) + sizeof(struct IndexNode*) * EVENT_INDEX_MAX_HEIGHT);
+  if (!list->index || pthread_rwlock_init(&list->rwl, NULL) != 0) {
+    free(list->index);
     free(list);
     return NULL;
   }
   list->head = NULL;
   list->tail = NULL;
+  list->index->height = EVENT_INDEX_MAX_HEIGHT;
+  list->index_height = 1;
+  list->index_seed = 2463534242u;
   return list;
 }
 
+/// Allocates the index node of an event, not linked yet.
+/// @param list Event list the node will be linked in.
+/// @param event Event to be indexed.
+/// @return The node, NULL on failure.
+static struct IndexNode* new_index_node(struct EventList* list, struct Event* event) {
+  // Each level keeps about one node in 4 of the level below
+  size_t height = 1;
+  while (height < EVENT_INDEX_MAX_HEIGHT) {
+    list->index_seed ^= list->index_seed << 13;
+    list->index_seed ^= list->index_seed >> 17;
+    list->index_seed ^= list->index_seed << 5;
+    if ((list->index_seed & 3) != 0) {
+      break;
+    }
+    height++;
+  }
+
+  struct IndexNode* node = malloc(sizeof(struct IndexNode) + sizeof(struct IndexNode*) * height);
+  if (!node) return NULL;
+  node->event = event;
+  node->height = height;
+  return node;
+}
+
+/// Links an index node in every level it belongs to, after the last node with a lower id.
+/// @param list Event list the node belongs to.
+/// @param node Node to be linked.
+static void link_index_node(struct EventList* list, struct IndexNode* node) {
+  struct IndexNode* prev = list->index;
+  if (node->height > list->index_height) {
+    list->index_height = node->height;
+  }
+
+  for (size_t level = list->index_height; level-- > 0;) {
+    while (prev->next[level] != NULL && prev->next[level]->event->id < node->event->id) {
+      prev = prev->next[level];
+    }
+    if (level < node->height) {
+      node->next[level] = prev->next[level];
+      prev->next[level] = node;
+    }
+  }
+}
+
+struct IndexNode* index_lower_bound(struct EventList* list, unsigned int event_id) {
+  struct IndexNode* prev = list->index;
+  for (size_t level = list->index_height; level-- > 0;) {
+    while (prev->next[level] != NULL && prev->next[level]->event->id < event_id) {
+      prev = prev->next[level];
+    }
+  }
+  return prev->next[0];
+}
+
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
   struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
-  if (!new_node) return 1;
+  struct IndexNode* index_node = new_index_node(list, event);
+  if (!new_node || !index_node) {
+    free(new_node);
+    free(index_node);
+    return 1;
+  }
 
   new_node->event = event;
   new_node->next = NULL;
+  link_index_node(list, index_node);
 
   if (list->head == NULL) {
     list->head = new_node;
@@ -35,9 +101,76 @@ int append_to_list(struct EventList* list, struct Event* event) {
   return 0;
 }
 
+int append_all_to_list(struct EventList* list, struct Event** events, size_t num_events) {
+  if (!list || num_events == 0) return num_events != 0;
+
+  // Every node is allocated before the list is touched, so a failure leaves it as it was
+  struct IndexNode** index_nodes = malloc(sizeof(struct IndexNode*) * num_events);
+  struct ListNode* first = NULL;
+  struct ListNode* last = NULL;
+  for (size_t i = 0; i < num_events; i++) {
+    struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
+    if (index_nodes) {
+      index_nodes[i] = new_index_node(list, events[i]);
+    }
+    if (!new_node || !index_nodes || !index_nodes[i]) {
+      for (size_t j = 0; index_nodes && j <= i; j++) {
+        free(index_nodes[j]);
+      }
+      free(index_nodes);
+      free(new_node);
+      while (first) {
+        struct ListNode* temp = first;
+        first = first->next;
+        free(temp);
+      }
+      return 1;
+    }
+
+    new_node->event = events[i];
+    new_node->next = NULL;
+    if (last == NULL) {
+      first = new_node;
+    } else {
+      last->next = new_node;
+    }
+    last = new_node;
+  }
+
+  if (list->head == NULL) {
+    list->head = first;
+  } else {
+    list->tail->next = first;
+  }
+  list->tail = last;
+
+  for (size_t i = 0; i < num_events; i++) {
+    link_index_node(list, index_nodes[i]);
+  }
+  free(index_nodes);
+  return 0;
+}
+
 static void free_event(struct Event* event) {
   if (!event) return;
-  free(event->data);
+  if (event->arena) {
+    if (--event->arena->users == 0) {
+      free(event->arena->data);
+      free(event->arena);
+    }
+  } else if (event->mapped_size > 0) {
+    munmap(event->data, event->mapped_size);
+    free(event->copied);
+  } else {
+    free(event->data);
+  }
+  if (!event->shares_grid) {
+    free(event->row_reserved);
+    free(event->free_runs);
+  }
+  buffer_free(&event->reservation_seats);
+  buffer_free(&event->reservation_index);
+  free(event->changes);
   free(event);
 }
 
@@ -53,6 +186,13 @@ void free_list(struct EventList* list) {
     free(temp);
   }
 
+  struct IndexNode* node = list->index;
+  while (node) {
+    struct IndexNode* temp = node;
+    node = node->next[0];
+    free(temp);
+  }
+
   free(list);
 }
 
@@ -3,6 +3,40 @@
 
 #include <pthread.h>
 #include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "common/io.h"
+
+#define EVENT_CHANGE_LOG_SIZE 1024  // Seat changes kept per event to answer SHOW_SINCE with a delta
+#define EVENT_INDEX_MAX_HEIGHT 16    // Levels of the id index, each one skipping about 4 times more events
+
+struct Subscription;
+
+struct SeatChange {
+  unsigned int version;         /// Event version that made the change.
+  unsigned int seat;            /// Index of the seat that changed.
+  unsigned int reservation_id;  /// New value of the seat.
+};
+
+/// Run of free seats in a row.
+struct FreeRun {
+  size_t start;   /// Column of the first seat.
+  size_t length;  /// Number of seats, 0 if the row is full.
+};
+
+/// Seats of one reservation, in the seat arena of its event.
+struct ReservationSeats {
+  size_t first;  /// Position of the first seat in the arena.
+  size_t count;  /// Number of seats, 0 once the reservation is cancelled.
+};
+
+/// Grids of a bulk creation, allocated at once and freed once none of its events uses them.
+struct GridArena {
+  unsigned int* data;
+  size_t size;   /// Bytes of data.
+  size_t users;  /// Events whose grid is still in the arena, only changed by the tiering worker or on shutdown.
+};
 
 struct Event {
   unsigned int id;            /// Event id
@@ -11,8 +45,31 @@ struct Event {
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  unsigned int* data;     /// Array of size rows * cols with the reservations for each seat.
+  unsigned int* data;     /// Array of size rows * cols with the reservations for each seat, NULL while spilled.
   pthread_mutex_t mutex;  // Mutex to protect the event
+
+  size_t* row_reserved;   /// Array of size rows with the number of taken seats in each row.
+  size_t reserved_seats;  /// Number of taken seats, so occupancy queries never scan the grid.
+  struct FreeRun* free_runs;  /// Array of size rows with the longest run of free seats in each row.
+  int shares_grid;            /// Whether row_reserved and free_runs belong to the arenas of a bulk creation's first event.
+  struct GridArena* arena;    /// Arena holding data, NULL if data was allocated or mapped for this event alone.
+  size_t mapped_size;         /// Size of the copy-on-write mapping of a template holding data, 0 if data was allocated.
+  unsigned char* copied;      /// Bit per page of the mapping, set once a write copies the page, NULL if not counted.
+  off_t spill_offset;         /// Where the grid goes in the spill file, -1 until it is first written there.
+  time_t last_access;         /// Monotonic time in seconds of the last operation that read or wrote the grid.
+
+  struct Buffer reservation_seats;  /// Arena with the indexes of the seats of every reservation, in order.
+  struct Buffer reservation_index;  /// ReservationSeats of every reservation, by id - 1.
+
+  unsigned int version;         /// Starts at 1 and is bumped by every reservation.
+  struct SeatChange* changes;   /// Ring buffer with the last EVENT_CHANGE_LOG_SIZE changes, allocated on first use.
+  size_t num_changes;           /// Number of changes ever logged.
+  unsigned int changes_base;    /// Every change made after this version is still in the log.
+
+  struct Subscription* subscribers;  /// Sessions notified of every reservation.
+
+  unsigned int slot;        /// Slot of the event in the table addressed by handles.
+  unsigned int generation;  /// Tells handles to this event apart from stale ones to an earlier slot user.
 };
 
 struct ListNode {
@@ -20,23 +77,41 @@ struct ListNode {
   struct ListNode* next;
 };
 
+/// Node of the skip list indexing the events by id.
+struct IndexNode {
+  struct Event* event;
+  size_t height;              /// Number of levels the node is linked in.
+  struct IndexNode* next[];  /// Next node in each level, with a greater id.
+};
+
 // Linked list structure
 struct EventList {
   struct ListNode* head;  // Head of the list
   struct ListNode* tail;  // Tail of the list
   pthread_rwlock_t rwl;   // Mutex to protect the list
+
+  struct IndexNode* index;  // Sentinel of the id index, ahead of every event in every level
+  size_t index_height;      // Levels in use by the id index
+  unsigned int index_seed;  // State of the generator picking the height of new index nodes
 };
 
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList* create_list();
 
-/// Appends a new node to the list.
+/// Appends a new node to the list, and indexes its event by id.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
 int append_to_list(struct EventList* list, struct Event* data);
 
+/// Appends several new nodes to the list and indexes their events by id, either all of them or none.
+/// @param list Event list to be modified.
+/// @param events Array of events to be stored in the new nodes, in order.
+/// @param num_events Number of events.
+/// @return 0 if the nodes were appended successfully, 1 otherwise.
+int append_all_to_list(struct EventList* list, struct Event** events, size_t num_events);
+
 /// Removes a node from the list.
 /// @param list Event list to be modified.
 /// @return 0 if the node was removed successfully, 1 otherwise.
@@ -50,4 +125,11 @@ void free_list(struct EventList* list);
 /// @return Pointer to the event if found, NULL otherwise.
 struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to);
 
+/// Finds the first event in id order whose id is not below the given one, in O(log n).
+/// @note The list lock must be held, the following events are reached through next[0].
+/// @param list Event list to be searched.
+/// @param event_id Lowest id wanted.
+/// @return The index node of the event, NULL if every id is lower.
+struct IndexNode* index_lower_bound(struct EventList* list, unsigned int event_id);
+
 #endif  // SERVER_EVENT_LIST_H
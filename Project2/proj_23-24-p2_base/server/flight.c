@@ -0,0 +1,113 @@
+#include "flight.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common/constants.h"
+#include "common/io.h"
+#include "operations.h"
+
+/// SHOW being built, shared by every identical request that arrives meanwhile.
+struct Flight {
+  char op;
+  struct EventRef event;
+  unsigned int since_version;
+  char features;
+
+  struct Buffer response;  /// Built by the first request, read-only once done.
+  int result;              /// Outcome of building the response.
+  int done;                /// Whether the response is built, the flight then leaves the in-flight list.
+  size_t refs;             /// Requests still using the response, the last one frees the flight.
+  struct Flight *next;
+};
+
+// SHOWs whose response is still being built
+static struct Flight *in_flight = NULL;
+static pthread_mutex_t flight_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flight_done = PTHREAD_COND_INITIALIZER;
+
+/// Finds a flight being built for the same request.
+/// @note The flight lock must be held.
+/// @return The flight, NULL if there is none.
+static struct Flight *find_flight(char op, const struct EventRef *event, unsigned int since_version, char features) {
+  for (struct Flight *flight = in_flight; flight != NULL; flight = flight->next) {
+    // Requests with and without a handle are told apart, a stale handle must fail on its own
+    if (flight->op == op && flight->event.id == event->id && flight->event.slot == event->slot &&
+        flight->event.generation == event->generation && flight->since_version == since_version &&
+        flight->features == features) {
+      return flight;
+    }
+  }
+  return NULL;
+}
+
+/// Builds the response of a flight, then hands it to every request waiting for it.
+/// @param flight Flight to build, already in the in-flight list.
+/// @param cache Event cache of the session building the flight.
+static void build_flight(struct Flight *flight, struct EventCache *cache) {
+  if (flight->op == EMS_SHOW_CODE) {
+    flight->result = ems_show(&flight->response, &flight->event, cache, flight->features);
+  } else {
+    flight->result =
+        ems_show_since(&flight->response, &flight->event, cache, flight->since_version, flight->features);
+  }
+
+  // Requests arriving from now on could see a newer grid, so they start a flight of their own
+  pthread_mutex_lock(&flight_mutex);
+  struct Flight **prev = &in_flight;
+  while (*prev != flight) {
+    prev = &(*prev)->next;
+  }
+  *prev = flight->next;
+  flight->done = 1;
+  pthread_cond_broadcast(&flight_done);
+  pthread_mutex_unlock(&flight_mutex);
+}
+
+int flight_show(struct Session *session, const struct Request *request, const struct EventRef *event,
+                unsigned int since_version) {
+  char features = session->connection->features;
+
+  pthread_mutex_lock(&flight_mutex);
+  struct Flight *flight = find_flight(request->op, event, since_version, features);
+  if (flight != NULL) {
+    flight->refs++;
+    while (!flight->done) {
+      pthread_cond_wait(&flight_done, &flight_mutex);
+    }
+    pthread_mutex_unlock(&flight_mutex);
+  } else {
+    flight = calloc(1, sizeof(struct Flight));
+    if (flight == NULL) {
+      pthread_mutex_unlock(&flight_mutex);
+      fprintf(stderr, "Failed to allocate memory for a SHOW of session %d.\n", session->id);
+      int return_value = FAIL_MSG;
+      session_respond(session, request, &return_value, sizeof(int));
+      return 1;
+    }
+
+    flight->op = request->op;
+    flight->event = *event;
+    flight->since_version = since_version;
+    flight->features = features;
+    flight->refs = 1;
+    flight->next = in_flight;
+    in_flight = flight;
+    pthread_mutex_unlock(&flight_mutex);
+
+    build_flight(flight, &session->events);
+  }
+
+  int result = session_respond(session, request, flight->response.data, flight->response.size) || flight->result;
+
+  pthread_mutex_lock(&flight_mutex);
+  size_t refs = --flight->refs;
+  pthread_mutex_unlock(&flight_mutex);
+
+  if (refs == 0) {
+    buffer_free(&flight->response);
+    free(flight);
+  }
+  return result;
+}
@@ -0,0 +1,19 @@
+#ifndef SERVER_FLIGHT_H
+#define SERVER_FLIGHT_H
+
+#include "common/codec.h"
+#include "session.h"
+
+/// Serves a SHOW or SHOW_SINCE request, sharing the work with identical requests being served at the same time.
+/// @note The first request for an event, version and encoding looks the event up and builds the response, the
+///       ones arriving before it is built wait for it and get the same bytes. Each one is then written to its own
+///       session, so the request answered is always the caller's.
+/// @param session Session the request belongs to.
+/// @param request Request being served.
+/// @param event Event to show.
+/// @param since_version Version of the grid the client has for SHOW_SINCE, 0 for SHOW.
+/// @return 0 if the event was shown and the response written, 1 otherwise.
+int flight_show(struct Session *session, const struct Request *request, const struct EventRef *event,
+                unsigned int since_version);
+
+#endif  // SERVER_FLIGHT_H
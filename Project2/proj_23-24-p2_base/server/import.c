@@ -0,0 +1,365 @@
+#include "import.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common/io.h"
+#include "common/parser.h"
+#include "operations.h"
+
+static int import_dir_fd = -1;  // Directory dumps are opened in, -1 while imports are refused
+
+/// Reservation read from a dump, whose seats are in the seats of the same chunk.
+struct ParsedReservation {
+  unsigned int event_id;
+  size_t num_seats;
+};
+
+/// Part of a dump parsed by one thread, made of whole lines.
+struct ImportChunk {
+  struct Span in;
+  struct Buffer events;        /// ImportedEvent of every event line, without reservations.
+  struct Buffer reservations;  /// ParsedReservation of every reservation line.
+  struct Buffer seats;         /// Row and column of every seat of every reservation, back to back.
+  const char *error;           /// Start of the line that could not be parsed, NULL if every line was.
+};
+
+/// Parses an unsigned integer field, taking the character that ends it as well.
+/// @param in The span to read from.
+/// @param value Pointer to the variable to store the value in.
+/// @param next Pointer to the variable to store the next character in, '\n' at the end of the span.
+/// @return 0 if the field was parsed successfully, 1 if it is empty or too large.
+static int parse_field(struct Span *in, unsigned int *value, char *next) {
+  const char *start = in->pos;
+  unsigned long ul = 0;
+  while (in->pos != in->end && *in->pos >= '0' && *in->pos <= '9') {
+    ul = ul * 10 + (unsigned long)(*in->pos++ - '0');
+    if (ul > UINT_MAX) {
+      return 1;
+    }
+  }
+  if (in->pos == start) {
+    return 1;
+  }
+
+  *next = in->pos != in->end ? *in->pos++ : '\n';
+  if (*next == '\r' && in->pos != in->end && *in->pos == '\n') {
+    *next = *in->pos++;
+  }
+  *value = (unsigned int)ul;
+  return 0;
+}
+
+/// Parses one line of a dump into its chunk.
+/// @param chunk Chunk the line belongs to, positioned at its start.
+/// @return 0 if the line was parsed successfully, 1 otherwise.
+static int parse_line(struct ImportChunk *chunk) {
+  struct Span *in = &chunk->in;
+  char kind = *in->pos;
+  if (kind == '\n' || kind == '\r' || kind == '#') {
+    const char *newline = memchr(in->pos, '\n', (size_t)(in->end - in->pos));
+    in->pos = newline != NULL ? newline + 1 : in->end;
+    return 0;
+  }
+
+  if ((kind != 'E' && kind != 'R') || in->end - in->pos < 2 || in->pos[1] != ',') {
+    return 1;
+  }
+  in->pos += 2;
+
+  unsigned int event_id, rows, cols;
+  char next;
+  if (parse_field(in, &event_id, &next) != 0 || next != ',') {
+    return 1;
+  }
+
+  if (kind == 'E') {
+    struct ImportedEvent event = {event_id, 0, 0, 0, NULL, NULL};
+    if (parse_field(in, &rows, &next) != 0 || next != ',' || parse_field(in, &cols, &next) != 0 || next != '\n' ||
+        rows == 0 || cols == 0) {
+      return 1;
+    }
+    event.rows = rows;
+    event.cols = cols;
+    return buffer_append(&chunk->events, &event, sizeof(struct ImportedEvent));
+  }
+
+  struct ParsedReservation reservation = {event_id, 0};
+  while (next == ',') {
+    unsigned int x, y;
+    if (parse_field(in, &x, &next) != 0 || next != ',' || parse_field(in, &y, &next) != 0) {
+      return 1;
+    }
+    size_t seat[2] = {x, y};
+    if (buffer_append(&chunk->seats, seat, sizeof(seat)) != 0) {
+      return 1;
+    }
+    reservation.num_seats++;
+  }
+  return next != '\n' || buffer_append(&chunk->reservations, &reservation, sizeof(struct ParsedReservation));
+}
+
+/// Parses every line of a chunk, stopping at the first one that can't be parsed.
+/// @param arg The ImportChunk to parse.
+/// @return NULL.
+static void *parse_chunk(void *arg) {
+  struct ImportChunk *chunk = arg;
+  while (chunk->in.pos != chunk->in.end) {
+    const char *line = chunk->in.pos;
+    if (parse_line(chunk) != 0) {
+      chunk->error = line;
+      break;
+    }
+  }
+  return NULL;
+}
+
+/// Compares the ids of two imported events, for qsort.
+static int compare_imported_events(const void *a, const void *b) {
+  unsigned int id_a = ((const struct ImportedEvent *)a)->id;
+  unsigned int id_b = ((const struct ImportedEvent *)b)->id;
+  return (id_a > id_b) - (id_a < id_b);
+}
+
+/// Compares an event id with the id of an imported event, for bsearch.
+static int compare_event_id(const void *key, const void *element) {
+  unsigned int id = *(const unsigned int *)key;
+  unsigned int imported_id = ((const struct ImportedEvent *)element)->id;
+  return (id > imported_id) - (id < imported_id);
+}
+
+/// Gets the current monotonic time in seconds, to report how long the import took.
+static double now_s(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/// Gathers the events of every chunk and hands each one its reservations, in the order of the dump.
+/// @param chunks Array of parsed chunks, in the order of the dump.
+/// @param num_chunks Number of chunks.
+/// @param num_threads Number of threads building the events.
+/// @param num_reservations Pointer to the variable to store the number of reservations imported in.
+/// @return The number of events imported, or (size_t)-1 on failure.
+static size_t import_chunks(struct ImportChunk *chunks, size_t num_chunks, size_t num_threads,
+                            size_t *num_reservations) {
+  size_t num_events = 0, num_seats = 0;
+  *num_reservations = 0;
+  for (size_t c = 0; c < num_chunks; c++) {
+    num_events += chunks[c].events.size / sizeof(struct ImportedEvent);
+    *num_reservations += chunks[c].reservations.size / sizeof(struct ParsedReservation);
+    num_seats += chunks[c].seats.size / (2 * sizeof(size_t));
+  }
+
+  struct ImportedEvent *events = malloc(sizeof(struct ImportedEvent) * (num_events > 0 ? num_events : 1));
+  size_t *owners = malloc(sizeof(size_t) * (*num_reservations > 0 ? *num_reservations : 1));
+  size_t *sizes = malloc(sizeof(size_t) * (*num_reservations > 0 ? *num_reservations : 1));
+  size_t *seats = malloc(2 * sizeof(size_t) * (num_seats > 0 ? num_seats : 1));
+  size_t *next_reservation = calloc(num_events > 0 ? num_events : 1, sizeof(size_t));
+  size_t *next_seat = calloc(num_events > 0 ? num_events : 1, sizeof(size_t));
+  size_t result = (size_t)-1;
+  if (events == NULL || owners == NULL || sizes == NULL || seats == NULL || next_reservation == NULL ||
+      next_seat == NULL) {
+    fprintf(stderr, "Failed to allocate memory for the import.\n");
+    goto done;
+  }
+
+  size_t e = 0;
+  for (size_t c = 0; c < num_chunks; c++) {
+    memcpy(events + e, chunks[c].events.data, chunks[c].events.size);
+    e += chunks[c].events.size / sizeof(struct ImportedEvent);
+  }
+  qsort(events, num_events, sizeof(struct ImportedEvent), compare_imported_events);
+  for (e = 1; e < num_events; e++) {
+    if (events[e].id == events[e - 1].id) {
+      fprintf(stderr, "Event %u is imported twice.\n", events[e].id);
+      goto done;
+    }
+  }
+
+  // Reservations are counted per event first, so each event gets its own contiguous run of them
+  size_t r = 0;
+  for (size_t c = 0; c < num_chunks; c++) {
+    const struct ParsedReservation *parsed = (const struct ParsedReservation *)chunks[c].reservations.data;
+    for (size_t i = 0; i < chunks[c].reservations.size / sizeof(struct ParsedReservation); i++, r++) {
+      const struct ImportedEvent *owner =
+          bsearch(&parsed[i].event_id, events, num_events, sizeof(struct ImportedEvent), compare_event_id);
+      if (owner == NULL) {
+        fprintf(stderr, "Reservation for event %u, which is not imported.\n", parsed[i].event_id);
+        goto done;
+      }
+      owners[r] = (size_t)(owner - events);
+      events[owners[r]].num_reservations++;
+      next_seat[owners[r]] += parsed[i].num_seats;
+    }
+  }
+
+  size_t reservation_offset = 0, seat_offset = 0;
+  for (e = 0; e < num_events; e++) {
+    size_t event_seats = next_seat[e];
+    next_reservation[e] = reservation_offset;
+    next_seat[e] = seat_offset;
+    events[e].reservation_sizes = sizes + reservation_offset;
+    events[e].seats = seats + 2 * seat_offset;
+    reservation_offset += events[e].num_reservations;
+    seat_offset += event_seats;
+  }
+
+  r = 0;
+  for (size_t c = 0; c < num_chunks; c++) {
+    const struct ParsedReservation *parsed = (const struct ParsedReservation *)chunks[c].reservations.data;
+    const size_t *seat = (const size_t *)chunks[c].seats.data;
+    for (size_t i = 0; i < chunks[c].reservations.size / sizeof(struct ParsedReservation); i++, r++) {
+      size_t owner = owners[r];
+      sizes[next_reservation[owner]++] = parsed[i].num_seats;
+      memcpy(seats + 2 * next_seat[owner], seat, 2 * sizeof(size_t) * parsed[i].num_seats);
+      next_seat[owner] += parsed[i].num_seats;
+      seat += 2 * parsed[i].num_seats;
+    }
+  }
+
+  if (ems_import(num_events, events, num_threads) == 0) {
+    result = num_events;
+  }
+
+done:
+  free(events);
+  free(owners);
+  free(sizes);
+  free(seats);
+  free(next_reservation);
+  free(next_seat);
+  return result;
+}
+
+/// Maps a dump of the import directory.
+/// @note The dump is opened without blocking and must be a regular file, so a client naming a FIFO or a device can
+///       neither stall the worker serving it nor have the server read without end.
+/// @param name Name of the dump in the import directory.
+/// @param file Pointer to the variable to store the contents in.
+/// @return 0 if the dump was mapped successfully, 1 otherwise.
+static int open_dump(const char *name, struct JobFile *file) {
+  if (import_dir_fd == -1) {
+    fprintf(stderr, "Imports are disabled, the server has no import directory.\n");
+    return 1;
+  }
+  if (name[0] == '\0' || strchr(name, '/') != NULL) {
+    fprintf(stderr, "Dumps must be named by their name in the import directory. Name: %s\n", name);
+    return 1;
+  }
+
+  int fd = openat(import_dir_fd, name, O_RDONLY | O_NONBLOCK | O_NOFOLLOW);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > (off_t)IMPORT_MAX_SIZE) {
+    fprintf(stderr, "The dump is not a regular file of at most %lu bytes. Name: %s\n", IMPORT_MAX_SIZE, name);
+    if (fd != -1) {
+      close(fd);
+    }
+    return 1;
+  }
+
+  file->data = NULL;
+  file->size = (size_t)st.st_size;
+  file->mapped = file->size > 0;
+  if (file->mapped) {
+    void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    file->data = data != MAP_FAILED ? data : NULL;
+  }
+  close(fd);
+
+  if (file->mapped && file->data == NULL) {
+    fprintf(stderr, "Failed to map the dump. Name: %s\n", name);
+    return 1;
+  }
+  return 0;
+}
+
+int import_init(const char *dir) {
+  import_dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+  if (import_dir_fd == -1) {
+    fprintf(stderr, "Failed to open the import directory. Path: %s\n", dir);
+    return 1;
+  }
+  return 0;
+}
+
+int import_file(const char *name) {
+  double start = now_s();
+  struct JobFile file;
+  if (open_dump(name, &file) != 0) {
+    return 1;
+  }
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t num_threads = cores < 1 ? 1 : cores > IMPORT_MAX_THREADS ? IMPORT_MAX_THREADS : (size_t)cores;
+  struct ImportChunk chunks[IMPORT_MAX_THREADS];
+  pthread_t threads[IMPORT_MAX_THREADS];
+
+  // The dump is split in about equal parts, each one ending at the end of a line
+  const char *end = file.data + file.size;
+  const char *pos = file.data;
+  size_t num_chunks = 0;
+  for (; num_chunks < num_threads && pos != end; num_chunks++) {
+    const char *split = num_chunks + 1 == num_threads ? end : file.data + file.size / num_threads * (num_chunks + 1);
+    if (split < pos) {
+      split = pos;
+    }
+    const char *newline = split != end ? memchr(split, '\n', (size_t)(end - split)) : NULL;
+    const char *chunk_end = newline != NULL ? newline + 1 : end;
+    chunks[num_chunks] = (struct ImportChunk){{pos, chunk_end}, {NULL, 0, 0}, {NULL, 0, 0}, {NULL, 0, 0}, NULL};
+    pos = chunk_end;
+  }
+
+  size_t started = 0;
+  for (; started < num_chunks; started++) {
+    if (pthread_create(&threads[started], NULL, &parse_chunk, &chunks[started]) != 0) {
+      break;
+    }
+  }
+  for (size_t c = started; c < num_chunks; c++) {
+    parse_chunk(&chunks[c]);
+  }
+  for (size_t c = 0; c < started; c++) {
+    pthread_join(threads[c], NULL);
+  }
+
+  int result = 0;
+  size_t num_events = 0, num_reservations = 0;
+  for (size_t c = 0; result == 0 && c < num_chunks; c++) {
+    if (chunks[c].error != NULL) {
+      size_t line = 1;
+      for (const char *p = file.data; (p = memchr(p, '\n', (size_t)(chunks[c].error - p))) != NULL; p++) {
+        line++;
+      }
+      fprintf(stderr, "Invalid line %zu in the dump. Name: %s\n", line, name);
+      result = 1;
+    }
+  }
+
+  if (result == 0) {
+    num_events = import_chunks(chunks, num_chunks, num_threads, &num_reservations);
+    result = num_events == (size_t)-1;
+  }
+
+  for (size_t c = 0; c < num_chunks; c++) {
+    buffer_free(&chunks[c].events);
+    buffer_free(&chunks[c].reservations);
+    buffer_free(&chunks[c].seats);
+  }
+  job_file_close(&file);
+
+  if (result == 0) {
+    fprintf(stderr, "Imported %zu events and %zu reservations in %.3fs with %zu threads. Name: %s\n", num_events,
+            num_reservations, now_s() - start, num_threads, name);
+  }
+  return result;
+}
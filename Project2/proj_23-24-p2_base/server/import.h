@@ -0,0 +1,24 @@
+#ifndef SERVER_IMPORT_H
+#define SERVER_IMPORT_H
+
+#include <stddef.h>
+
+#define IMPORT_MAX_THREADS 64        // Most threads parsing a dump and building its events
+#define IMPORT_MAX_SIZE (1UL << 30)  // Largest dump accepted, in bytes
+
+/// Sets the directory dumps are imported from, imports are refused until it is set.
+/// @param dir Path of the directory.
+/// @return 0 if the directory was opened successfully, 1 otherwise.
+int import_init(const char *dir);
+
+/// Creates the events and reservations of a CSV dump, using every core.
+/// @note Each line of the dump is either an event, "E,<event_id>,<rows>,<cols>", or a reservation of one,
+///       "R,<event_id>,<x1>,<y1>[,<x2>,<y2>...]". Empty lines and lines starting with '#' are skipped. Reservations
+///       get ids from 1 in the order they appear, and may come before their event. Either the whole dump is
+///       imported or nothing is.
+/// @param name Name of the dump in the import directory, which must be a regular file of at most IMPORT_MAX_SIZE
+///             bytes. Names with a '/' and symbolic links are refused, so clients can't reach outside the directory.
+/// @return 0 if the dump was imported successfully, 1 otherwise.
+int import_file(const char *name);
+
+#endif  // SERVER_IMPORT_H
@@ -0,0 +1,165 @@
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "common/io.h"
+#include "common/parser.h"
+#include "operations.h"
+
+#define JOBS_KNOWN_EVENTS 16  // Events created by a script that its later commands address by handle
+
+/// Handles to the latest events created by a script, so its later commands skip the lookup.
+struct KnownEvents {
+  struct EventRef refs[JOBS_KNOWN_EVENTS];
+  size_t next;
+};
+
+/// Gets the handle to an event created by the script, or an id-only reference if there is none.
+/// @param known Events created by the script.
+/// @param event_id Id of the event.
+/// @return Reference to the event.
+static struct EventRef known_event(const struct KnownEvents *known, unsigned int event_id) {
+  for (size_t i = 0; i < JOBS_KNOWN_EVENTS; i++) {
+    if (known->refs[i].generation != 0 && known->refs[i].id == event_id) {
+      return known->refs[i];
+    }
+  }
+  return (struct EventRef){event_id, 0, 0};
+}
+
+/// Creates every event of a range of ids at once.
+/// @param first_id Id of the first event.
+/// @param last_id Id of the last event.
+/// @param num_rows Number of rows of each event.
+/// @param num_cols Number of columns of each event.
+/// @return 0 if the events were created successfully, 1 otherwise.
+static int create_range(unsigned int first_id, unsigned int last_id, size_t num_rows, size_t num_cols) {
+  size_t num_events = (size_t)(last_id - first_id) + 1;
+  unsigned int *event_ids = malloc(sizeof(unsigned int) * num_events);
+  if (event_ids == NULL) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < num_events; i++) {
+    event_ids[i] = first_id + (unsigned int)i;
+  }
+  int result = ems_create_many(num_events, event_ids, num_rows, num_cols);
+  free(event_ids);
+  return result;
+}
+
+/// Sends the output collected so far in a frame of its own.
+/// @param session Session running the script.
+/// @param request Request the output answers.
+/// @param out Output collected so far, after the leading 0 byte, emptied afterwards.
+/// @return 0 if the output was sent successfully, 1 otherwise.
+static int flush_output(struct Session *session, const struct Request *request, struct Buffer *out) {
+  if (out->size <= 1) {
+    return 0;
+  }
+
+  int result = session_respond(session, request, out->data, out->size);
+  out->size = 1;
+  return result;
+}
+
+int jobs_run(struct Session *session, const struct Request *request, const char *script, size_t size, size_t *failed) {
+  struct Buffer *out = &session->response;
+  struct Span in = {script, script + size};
+  struct SeatRange ranges[MAX_RESERVATION_SIZE];
+  struct KnownEvents known = {0};
+  char last = 0;
+
+  *failed = 0;
+  out->size = 0;
+  if (buffer_append(out, &last, sizeof(char)) != 0) {
+    return 1;
+  }
+
+  while (1) {
+    unsigned int event_id, last_event_id;
+    struct EventRef event;
+    size_t num_rows, num_columns, num_coords;
+    unsigned int delay = 0;
+
+    switch (get_next(&in)) {
+      case CMD_CREATE:
+        if (parse_create(&in, &event_id, &last_event_id, &num_rows, &num_columns) != 0) {
+          (*failed)++;
+          break;
+        }
+
+        if (last_event_id != event_id) {
+          if (create_range(event_id, last_event_id, num_rows, num_columns) != 0) {
+            (*failed)++;
+          }
+          break;
+        }
+
+        if (ems_create(event_id, num_rows, num_columns, &event) != 0) {
+          (*failed)++;
+          break;
+        }
+        known.refs[known.next++ % JOBS_KNOWN_EVENTS] = event;
+        break;
+
+      case CMD_RESERVE:
+        num_coords = parse_reserve(&in, MAX_RESERVATION_SIZE, &event_id, ranges);
+        event = known_event(&known, event_id);
+        if (num_coords == 0 || ems_reserve_ranges(&event, &session->events, num_coords, ranges) != 0) {
+          (*failed)++;
+        }
+        break;
+
+      case CMD_SHOW:
+        if (parse_show(&in, &event_id) != 0) {
+          (*failed)++;
+          break;
+        }
+        event = known_event(&known, event_id);
+        if (ems_show_text(out, &event, &session->events) != 0) {
+          (*failed)++;
+        }
+        break;
+
+      case CMD_LIST_EVENTS:
+        if (ems_list_events_text(out) != 0) {
+          (*failed)++;
+        }
+        break;
+
+      case CMD_WAIT:
+        if (parse_wait(&in, &delay, NULL) == -1) {
+          (*failed)++;
+          break;
+        }
+
+        // Let the client see everything printed before the pause
+        if (delay > 0) {
+          if (flush_output(session, request, out) != 0) {
+            return 1;
+          }
+          sleep(delay);
+        }
+        break;
+
+      case CMD_INVALID:
+        (*failed)++;
+        break;
+
+      case CMD_HELP:
+      case CMD_EMPTY:
+        break;
+
+      case EOC:
+        return flush_output(session, request, out);
+    }
+
+    if (out->size >= EMS_JOBS_CHUNK_SIZE && flush_output(session, request, out) != 0) {
+      return 1;
+    }
+  }
+}
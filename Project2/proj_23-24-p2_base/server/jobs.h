@@ -0,0 +1,18 @@
+#ifndef SERVER_JOBS_H
+#define SERVER_JOBS_H
+
+#include <stddef.h>
+
+#include "session.h"
+
+/// Runs the commands of a .jobs script as the client would, streaming what they print back to the client.
+/// @note The output goes out in RUN_JOBS frames starting with a 0 byte, the final frame is left to the caller.
+/// @param session Session running the script, its response buffer collects the output.
+/// @param request Request the output answers.
+/// @param script The script to run.
+/// @param size Size of the script.
+/// @param failed Pointer to the variable to store the number of commands that failed in.
+/// @return 0 if the script ran to the end, 1 if its output could not be sent.
+int jobs_run(struct Session *session, const struct Request *request, const char *script, size_t size, size_t *failed);
+
+#endif  // SERVER_JOBS_H
@@ -1,6 +1,7 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 
 #include <sys/stat.h>
@@ -10,13 +11,22 @@
 #include <errno.h>
 #include <semaphore.h>
 
+#include "common/codec.h"
 #include "common/constants.h"
 #include "common/io.h"
+#include "flight.h"
+#include "import.h"
+#include "jobs.h"
+#include "notify.h"
 #include "operations.h"
+#include "session.h"
+#include "tiering.h"
 #include "main.h"
 
 struct client_info {
-	int sv_fd;
+	char req_pipe_path[MAX_PIPENAME_SIZE];
+	char resp_pipe_path[MAX_PIPENAME_SIZE];
+	char features;
 	int session_id;
 };
 
@@ -31,10 +41,25 @@ int buffer_count = 0;
 
 char* server_pipe_path;
 
+static void handle_request(struct Session* session, struct Request* request);
+
 int main(int argc, char* argv[]) {
 
-	if (argc < 2 || argc > 3) {
-		fprintf(stderr, "Usage: %s\n <pipe_path> [delay]\n", argv[0]);
+	// Clients may only import dumps from a directory chosen here, imports are refused without one
+	const char* import_dir = NULL;
+	if (argc >= 3 && strcmp(argv[1], "-i") == 0) {
+		import_dir = argv[2];
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+
+	if (argc < 2 || argc > 5) {
+		fprintf(stderr, "Usage: %s\n [-i import_dir] <pipe_path> [delay [cold_after_s [spill_path]]]\n", argv[0]);
+		return 1;
+	}
+
+	if (import_dir != NULL && import_init(import_dir) != 0) {
 		return 1;
 	}
 
@@ -42,7 +67,7 @@ int main(int argc, char* argv[]) {
 
 	char* endptr;
 	unsigned int state_access_delay_us = STATE_ACCESS_DELAY_US;
-	if (argc == 3) {
+	if (argc >= 3) {
 		unsigned long int delay = strtoul(argv[2], &endptr, 10);
 
 		if (*endptr != '\0' || delay > UINT_MAX) {
@@ -58,6 +83,21 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
+	// Events untouched for cold_after_s seconds have their seats moved to the spill file until they are used again
+	if (argc >= 4) {
+		unsigned long int cold_after_s = strtoul(argv[3], &endptr, 10);
+
+		if (*endptr != '\0' || cold_after_s > UINT_MAX) {
+			fprintf(stderr, "Invalid cold event age or value too large\n");
+			return 1;
+		}
+
+		if (tiering_init((unsigned int)cold_after_s, argc == 5 ? argv[4] : NULL) != 0) {
+			fprintf(stderr, "Failed to initialize tiering\n");
+			return 1;
+		}
+	}
+
 	unlink(server_pipe_path);
 
 	if (mkfifo(server_pipe_path, S_IRUSR | S_IWUSR | S_IRGRP) != 0) {
@@ -67,6 +107,30 @@ int main(int argc, char* argv[]) {
 
 	///
 
+	pthread_t workers[REQUEST_WORKER_COUNT];
+	if (scheduler_init(&handle_request) != 0) {
+		fprintf(stderr, "Failed to initialize the request scheduler\n");
+		return 1;
+	}
+	for (int worker_id = 0; worker_id < REQUEST_WORKER_COUNT; worker_id++) {
+		if (pthread_create(&workers[worker_id], NULL, &scheduler_worker, NULL) != 0) {
+			fprintf(stderr, "Failed to create worker thread in the %d index of the workers array.", worker_id);
+			return 1;
+		}
+	}
+
+	pthread_t notifier;
+	if (pthread_create(&notifier, NULL, &notify_worker, NULL) != 0) {
+		fprintf(stderr, "Failed to create the notifier thread.");
+		return 1;
+	}
+
+	pthread_t tiering;
+	if (tiering_period() > 0 && pthread_create(&tiering, NULL, &ems_tiering_worker, NULL) != 0) {
+		fprintf(stderr, "Failed to create the tiering thread.");
+		return 1;
+	}
+
 	pthread_t threads[MAX_SESSION_COUNT];
 	pthread_mutex_init(&mutex_session, NULL);
     sem_init(&sem_empty, 0, MAX_SESSION_COUNT);
@@ -91,6 +155,14 @@ int main(int argc, char* argv[]) {
             perror("Failed to join thread");
         }
     }
+	for (int i = 0; i < REQUEST_WORKER_COUNT; i++) {
+        if (pthread_join(workers[i], NULL) != 0) {
+            perror("Failed to join thread");
+        }
+    }
+	if (pthread_join(notifier, NULL) != 0) {
+		perror("Failed to join thread");
+	}
 
 	sem_destroy(&sem_empty);
 	sem_destroy(&sem_full);
@@ -100,21 +172,646 @@ int main(int argc, char* argv[]) {
 	return 0;
 }
 
+/// Reads and drops bytes from the request pipe, to skip a request that can't be served.
+/// @param req_fd File descriptor of the request pipe.
+/// @param len Number of bytes to drop.
+static void discard_request(int req_fd, size_t len) {
+	char scratch[256];
+	while (len > 0) {
+		size_t chunk = len < sizeof(scratch) ? len : sizeof(scratch);
+		if (read_full(req_fd, scratch, chunk) != 0) {
+			return;
+		}
+		len -= chunk;
+	}
+}
+
+/// Makes sure the seat buffer of a session can hold the given number of seats.
+/// @param buffer Seat buffer of the session.
+/// @param num_seats Number of seats to hold.
+/// @return 0 if the buffer is large enough, 1 if it could not be grown.
+static int grow_seat_buffer(struct SeatBuffer* buffer, size_t num_seats) {
+	if (num_seats > buffer->seats_capacity) {
+		size_t* xs = realloc(buffer->xs, sizeof(size_t) * num_seats);
+		if (xs == NULL) {
+			return 1;
+		}
+		buffer->xs = xs;
+
+		size_t* ys = realloc(buffer->ys, sizeof(size_t) * num_seats);
+		if (ys == NULL) {
+			return 1;
+		}
+		buffer->ys = ys;
+		buffer->seats_capacity = num_seats;
+	}
+
+	return 0;
+}
+
+/// Serves a RESERVE request.
+/// @param session Session the request belongs to.
+/// @param reader Payload of the request.
+/// @return 0 if the seats were reserved, 1 otherwise.
+static int handle_reserve(struct Session* session, struct Reader* reader) {
+	struct EventRef event;
+	size_t num_seats, encoded_size;
+	if (reader_read(reader, &event, sizeof(struct EventRef)) != 0 ||
+		reader_read(reader, &num_seats, sizeof(size_t)) != 0 ||
+		reader_read(reader, &encoded_size, sizeof(size_t)) != 0) {
+		return 1;
+	}
+
+	// Every seat takes between 1 and VARINT_MAX_SIZE bytes
+	const unsigned char* encoded = reader_take(reader, encoded_size);
+	if (encoded == NULL || num_seats == 0 || encoded_size < num_seats || encoded_size / VARINT_MAX_SIZE > num_seats ||
+		grow_seat_buffer(&session->seats, num_seats) != 0) {
+		return 1;
+	}
+
+	if (seats_decode(encoded, encoded_size, num_seats, session->seats.xs, session->seats.ys) != 0) {
+		return 1;
+	}
+	return ems_reserve(&event, &session->events, num_seats, session->seats.xs, session->seats.ys);
+}
+
+/// Serves one chunk of a RESERVE_RANGES request, reserving the seats once the last chunk arrives.
+/// @param session Session the request belongs to.
+/// @param reader Payload of the chunk.
+/// @param respond Pointer to the variable to store whether the chunk must be answered in.
+/// @return 0 if the chunk was accepted, and on the last chunk if the seats were reserved, 1 otherwise.
+static int handle_reserve_ranges(struct Session* session, struct Reader* reader, char* respond) {
+	struct SeatBuffer* buffer = &session->seats;
+	struct EventRef event;
+	size_t chunk, encoded_size;
+	char last = 1;
+
+	if (reader_read(reader, &event, sizeof(struct EventRef)) != 0 || reader_read(reader, &last, sizeof(char)) != 0 ||
+		reader_read(reader, &chunk, sizeof(size_t)) != 0 || reader_read(reader, &encoded_size, sizeof(size_t)) != 0) {
+		// A chunk that can't be read still ends the request, so the next one starts clean
+		*respond = !buffer->discarding;
+		buffer->num_ranges = 0;
+		buffer->discarding = 0;
+		return 1;
+	}
+
+	// The request was already answered when an earlier chunk was rejected, the rest of it is dropped
+	if (buffer->discarding) {
+		buffer->discarding = !last;
+		*respond = 0;
+		return 1;
+	}
+
+	// Every range takes between 4 and SEAT_RANGE_MAX_SIZE bytes
+	const unsigned char* encoded = reader_take(reader, encoded_size);
+	int result = encoded == NULL || chunk > EMS_RANGE_CHUNK_SIZE || encoded_size < 4 * chunk ||
+				 encoded_size > SEAT_RANGE_MAX_SIZE * chunk;
+
+	if (result == 0 && buffer->num_ranges + chunk > buffer->ranges_capacity) {
+		size_t capacity = 2 * (buffer->num_ranges + chunk);
+		struct SeatRange* ranges = realloc(buffer->ranges, sizeof(struct SeatRange) * capacity);
+		if (ranges == NULL) {
+			result = 1;
+		} else {
+			buffer->ranges = ranges;
+			buffer->ranges_capacity = capacity;
+		}
+	}
+
+	if (result == 0) {
+		result = ranges_decode(encoded, encoded_size, chunk, buffer->ranges + buffer->num_ranges);
+	}
+
+	if (result != 0) {
+		// Answer right away and drop everything received so far, along with the chunks still to come
+		buffer->num_ranges = 0;
+		buffer->discarding = !last;
+		*respond = 1;
+		return 1;
+	}
+
+	buffer->num_ranges += chunk;
+	*respond = last;
+	if (!last) {
+		return 0;
+	}
+
+	size_t num_ranges = buffer->num_ranges;
+	buffer->num_ranges = 0;
+	return num_ranges == 0 || ems_reserve_ranges(&event, &session->events, num_ranges, buffer->ranges);
+}
+
+/// Serves a RESERVE_MULTI request.
+/// @param session Session the request belongs to.
+/// @param reader Payload of the request.
+/// @return 0 if the seats of every event were reserved, 1 otherwise.
+static int handle_reserve_multi(struct Session* session, struct Reader* reader) {
+	size_t num_parts;
+	if (reader_read(reader, &num_parts, sizeof(size_t)) != 0 || num_parts == 0 || num_parts > EMS_MULTI_MAX_EVENTS) {
+		return 1;
+	}
+
+	// The ranges of every part are decoded into one array, which the parts point into
+	struct EventReservation parts[EMS_MULTI_MAX_EVENTS];
+	struct SeatRange* ranges = malloc(sizeof(struct SeatRange) * MAX_RESERVATION_SIZE * num_parts);
+	if (ranges == NULL) {
+		fprintf(stderr, "Failed to allocate memory for a reservation of session %d.\n", session->id);
+		return 1;
+	}
+
+	size_t total = 0;
+	int result = 0;
+	for (size_t i = 0; result == 0 && i < num_parts; i++) {
+		size_t num_ranges, encoded_size;
+		const unsigned char* encoded = NULL;
+		// Every range takes between 4 and SEAT_RANGE_MAX_SIZE bytes
+		result = reader_read(reader, &parts[i].event, sizeof(struct EventRef)) != 0 ||
+				 reader_read(reader, &num_ranges, sizeof(size_t)) != 0 ||
+				 reader_read(reader, &encoded_size, sizeof(size_t)) != 0 || num_ranges == 0 ||
+				 num_ranges > MAX_RESERVATION_SIZE || encoded_size < 4 * num_ranges ||
+				 encoded_size > SEAT_RANGE_MAX_SIZE * num_ranges ||
+				 (encoded = reader_take(reader, encoded_size)) == NULL ||
+				 ranges_decode(encoded, encoded_size, num_ranges, ranges + total) != 0;
+
+		parts[i].num_ranges = num_ranges;
+		parts[i].ranges = ranges + total;
+		total += num_ranges;
+	}
+
+	result = result || ems_reserve_multi(num_parts, parts, &session->events);
+	free(ranges);
+	return result;
+}
+
+/// Serves one chunk of a RUN_JOBS request, running the script once the last chunk arrives.
+/// @param session Session the request belongs to.
+/// @param request Request being served, answered by the output of the script.
+/// @param reader Payload of the chunk.
+/// @param respond Pointer to the variable to store whether the chunk must be answered in.
+/// @param failed Pointer to the variable to store the number of commands that failed in.
+/// @return 0 if the chunk was accepted, and on the last chunk if the script ran, 1 otherwise.
+static int handle_run_jobs(struct Session* session, const struct Request* request, struct Reader* reader,
+						   char* respond, size_t* failed) {
+	struct Buffer* script = &session->script;
+	char last = 1;
+	*failed = 0;
+
+	if (reader_read(reader, &last, sizeof(char)) != 0) {
+		// A chunk that can't be read still ends the request, so the next one starts clean
+		*respond = !session->script_discarding;
+		script->size = 0;
+		session->script_discarding = 0;
+		return 1;
+	}
+
+	// The request was already answered when an earlier chunk was rejected, the rest of it is dropped
+	if (session->script_discarding) {
+		session->script_discarding = !last;
+		*respond = 0;
+		return 1;
+	}
+
+	size_t len = reader->size - reader->pos;
+	if (buffer_append(script, reader_take(reader, len), len) != 0) {
+		fprintf(stderr, "Failed to allocate memory for the script of session %d.\n", session->id);
+		buffer_free(script);
+		session->script_discarding = !last;
+		*respond = 1;
+		return 1;
+	}
+
+	*respond = last;
+	if (!last) {
+		return 0;
+	}
+
+	int result = jobs_run(session, request, script->data, script->size, failed);
+	script->size = 0;
+	return result;
+}
+
+/// Serves a SUBSCRIBE request.
+/// @param session Session the request belongs to.
+/// @param request Request being served, whose id every notification carries.
+/// @param reader Payload of the request.
+/// @return 0 if the session was subscribed to every event, 1 otherwise.
+static int handle_subscribe(struct Session* session, const struct Request* request, struct Reader* reader) {
+	size_t num_events;
+	if (reader_read(reader, &num_events, sizeof(size_t)) != 0 || num_events == 0 ||
+		num_events > (reader->size - reader->pos) / sizeof(unsigned int)) {
+		return 1;
+	}
+
+	unsigned int* event_ids = malloc(sizeof(unsigned int) * num_events);
+	if (event_ids == NULL || reader_read(reader, event_ids, sizeof(unsigned int) * num_events) != 0) {
+		free(event_ids);
+		return 1;
+	}
+
+	int result = notify_subscribe(session, request->id, num_events, event_ids);
+	free(event_ids);
+	return result;
+}
+
+/// Serves a CREATE_MANY request.
+/// @param reader Payload of the request.
+/// @return 0 if every event was created, 1 otherwise.
+static int handle_create_many(struct Reader* reader) {
+	size_t num_events, num_rows, num_cols;
+	if (reader_read(reader, &num_events, sizeof(size_t)) != 0 || reader_read(reader, &num_rows, sizeof(size_t)) != 0 ||
+		reader_read(reader, &num_cols, sizeof(size_t)) != 0 || num_events == 0 ||
+		num_events > (reader->size - reader->pos) / sizeof(unsigned int)) {
+		return 1;
+	}
+
+	unsigned int* event_ids = malloc(sizeof(unsigned int) * num_events);
+	if (event_ids == NULL || reader_read(reader, event_ids, sizeof(unsigned int) * num_events) != 0) {
+		free(event_ids);
+		return 1;
+	}
+
+	int result = ems_create_many(num_events, event_ids, num_rows, num_cols);
+	free(event_ids);
+	return result;
+}
+
+/// Serves a CREATE_TEMPLATE request.
+/// @param reader Payload of the request.
+/// @return 0 if the template was created, 1 otherwise.
+static int handle_create_template(struct Reader* reader) {
+	unsigned int template_id;
+	size_t num_rows, num_cols, num_blocked;
+	if (reader_read(reader, &template_id, sizeof(unsigned int)) != 0 ||
+		reader_read(reader, &num_rows, sizeof(size_t)) != 0 || reader_read(reader, &num_cols, sizeof(size_t)) != 0 ||
+		reader_read(reader, &num_blocked, sizeof(size_t)) != 0 ||
+		num_blocked > (reader->size - reader->pos) / (2 * sizeof(size_t))) {
+		return 1;
+	}
+
+	size_t* xs = malloc(sizeof(size_t) * (num_blocked > 0 ? num_blocked : 1));
+	size_t* ys = malloc(sizeof(size_t) * (num_blocked > 0 ? num_blocked : 1));
+	int result = xs == NULL || ys == NULL || reader_read(reader, xs, sizeof(size_t) * num_blocked) != 0 ||
+				 reader_read(reader, ys, sizeof(size_t) * num_blocked) != 0 ||
+				 ems_create_template(template_id, num_rows, num_cols, num_blocked, xs, ys) != 0;
+	free(xs);
+	free(ys);
+	return result;
+}
+
+/// Serves a CREATE_FROM_TEMPLATE request.
+/// @param reader Payload of the request.
+/// @return 0 if every event was created, 1 otherwise.
+static int handle_create_from_template(struct Reader* reader) {
+	unsigned int template_id;
+	size_t num_events;
+	if (reader_read(reader, &template_id, sizeof(unsigned int)) != 0 ||
+		reader_read(reader, &num_events, sizeof(size_t)) != 0 || num_events == 0 ||
+		num_events > (reader->size - reader->pos) / sizeof(unsigned int)) {
+		return 1;
+	}
+
+	unsigned int* event_ids = malloc(sizeof(unsigned int) * num_events);
+	if (event_ids == NULL || reader_read(reader, event_ids, sizeof(unsigned int) * num_events) != 0) {
+		free(event_ids);
+		return 1;
+	}
+
+	int result = ems_create_from_template(template_id, num_events, event_ids);
+	free(event_ids);
+	return result;
+}
+
+/// Serves an IMPORT request.
+/// @param reader Payload of the request, the name of the dump in the import directory.
+/// @return 0 if the whole dump was imported, 1 otherwise.
+static int handle_import(struct Reader* reader) {
+	char name[NAME_MAX + 1];
+	size_t len = reader->size - reader->pos;
+	if (len == 0 || len > NAME_MAX || reader_read(reader, name, len) != 0 || memchr(name, '\0', len) != NULL) {
+		return 1;
+	}
+	name[len] = '\0';
+	return import_file(name);
+}
+
+/// Serves a LIST request, streaming the ids in pages of up to EMS_LIST_PAGE_SIZE.
+/// @note Every page but the last starts with a 0 byte, the last one with a 1 and the outcome. The events listed are
+///       the ones created when the request is served, later ones are left for the next LIST.
+/// @param session Session the request belongs to.
+/// @param request Request being served, every page carries its id.
+/// @param resp Response buffer of the session, holding the last page once this returns.
+static void handle_list(struct Session* session, const struct Request* request, struct Buffer* resp) {
+	size_t num_events = ems_count_events();
+	size_t sent = 0;
+	int return_value = SUCCESS_MSG;
+	char last = 0;
+
+	while (!last) {
+		size_t page = num_events - sent < EMS_LIST_PAGE_SIZE ? num_events - sent : EMS_LIST_PAGE_SIZE;
+		last = sent + page == num_events;
+
+		resp->size = 0;
+		if (buffer_append(resp, &last, sizeof(char)) != 0 ||
+			(last && buffer_append(resp, &return_value, sizeof(int)) != 0) ||
+			buffer_append(resp, &page, sizeof(size_t)) != 0 || ems_list_events(resp, sent, page) != 0 ||
+			(!last && session_respond(session, request, resp->data, resp->size) != 0)) {
+			// The client already printed the pages sent, the failure tells it the list is incomplete
+			resp->size = 0;
+			last = 1;
+			return_value = FAIL_MSG;
+			buffer_append(resp, &last, sizeof(char));
+			buffer_append(resp, &return_value, sizeof(int));
+			return;
+		}
+		sent += page;
+	}
+}
+
+/// Serves a LIST_RANGE request.
+/// @param reader Payload of the request.
+/// @param resp Response to write the ids to.
+static void handle_list_range(struct Reader* reader, struct Buffer* resp) {
+	unsigned int first_id;
+	unsigned int last_id;
+	size_t min_free_seats;
+	size_t limit;
+	if (reader_read(reader, &first_id, sizeof(unsigned int)) != 0 ||
+		reader_read(reader, &last_id, sizeof(unsigned int)) != 0 ||
+		reader_read(reader, &min_free_seats, sizeof(size_t)) != 0 || reader_read(reader, &limit, sizeof(size_t)) != 0) {
+		int return_value = FAIL_MSG;
+		buffer_append(resp, &return_value, sizeof(int));
+		return;
+	}
+	ems_list_range(resp, first_id, last_id, min_free_seats, limit);
+}
+
+/// Serves a SHOW_MANY request.
+/// @param session Session the request belongs to.
+/// @param reader Payload of the request.
+/// @param resp Response to print the events to.
+static void handle_show_many(struct Session* session, struct Reader* reader, struct Buffer* resp) {
+	int return_value = FAIL_MSG;
+	size_t num_events;
+	if (reader_read(reader, &num_events, sizeof(size_t)) != 0 || num_events == 0 ||
+		num_events > EMS_SHOW_MANY_MAX_EVENTS || num_events > (reader->size - reader->pos) / sizeof(unsigned int)) {
+		buffer_append(resp, &return_value, sizeof(int));
+		return;
+	}
+
+	unsigned int event_ids[EMS_SHOW_MANY_MAX_EVENTS];
+	if (reader_read(reader, event_ids, sizeof(unsigned int) * num_events) != 0) {
+		buffer_append(resp, &return_value, sizeof(int));
+		return;
+	}
+	ems_show_many(resp, num_events, event_ids, session->connection->features);
+}
+
+/// Serves a request of a session and writes its response.
+/// @param session Session the request belongs to.
+/// @param request Request to serve.
+static void handle_request(struct Session* session, struct Request* request) {
+	struct Reader reader = {request->payload, request->size, 0};
+	struct Buffer* resp = &session->response;
+	int return_value = FAIL_MSG;
+
+	unsigned int event_id;
+	unsigned int version;
+	unsigned int reservation_id;
+	struct EventRef event;
+	size_t num_rows;
+	size_t num_cols;
+	size_t num_seats;
+	size_t near_row;
+	struct SeatRange range;
+	char respond;
+	char last;
+	char with_rows;
+	size_t failed;
+
+	resp->size = 0;
+	fprintf(stderr, "Working with OP_CODE %d.\n", request->op);
+	switch (request->op) {
+	case EMS_CREATE_CODE:
+		if (reader_read(&reader, &event_id, sizeof(unsigned int)) == 0 &&
+			reader_read(&reader, &num_rows, sizeof(size_t)) == 0 &&
+			reader_read(&reader, &num_cols, sizeof(size_t)) == 0 &&
+			ems_create(event_id, num_rows, num_cols, &event) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		// The creator gets a handle to the event right away
+		buffer_append(resp, &return_value, sizeof(int));
+		if (return_value == SUCCESS_MSG) {
+			buffer_append(resp, &event, sizeof(struct EventRef));
+		}
+		break;
+
+	case EMS_CREATE_MANY_CODE:
+		if (handle_create_many(&reader) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+
+	case EMS_CREATE_TEMPLATE_CODE:
+		if (handle_create_template(&reader) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+
+	case EMS_CREATE_FROM_TEMPLATE_CODE:
+		if (handle_create_from_template(&reader) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+
+	case EMS_IMPORT_CODE:
+		if (handle_import(&reader) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+
+	case EMS_OPEN_EVENT_CODE:
+		if (reader_read(&reader, &event_id, sizeof(unsigned int)) == 0 && ems_open_event(event_id, &event) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		if (return_value == SUCCESS_MSG) {
+			buffer_append(resp, &event, sizeof(struct EventRef));
+		}
+		break;
+
+	case EMS_QUIT_CODE:
+		// The session ends here, but its id stays known until the connection closes
+		fprintf(stderr, "Ended reading file!\n");
+		notify_cancel_all(session);
+		session_release_buffers(session);
+		return;
+
+	case EMS_RESERVE_CODE:
+		if (handle_reserve(session, &reader) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+
+	case EMS_RESERVE_RANGES_CODE:
+		if (handle_reserve_ranges(session, &reader, &respond) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		// Only the last chunk is answered, unless an earlier one was rejected
+		if (!respond) {
+			return;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+
+	case EMS_RESERVE_BEST_CODE:
+		if (reader_read(&reader, &event, sizeof(struct EventRef)) == 0 &&
+			reader_read(&reader, &num_seats, sizeof(size_t)) == 0 &&
+			reader_read(&reader, &near_row, sizeof(size_t)) == 0 &&
+			ems_reserve_best(&event, &session->events, num_seats, near_row, &range) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		// The client learns which seats it got
+		buffer_append(resp, &return_value, sizeof(int));
+		if (return_value == SUCCESS_MSG) {
+			buffer_append(resp, &range, sizeof(struct SeatRange));
+		}
+		break;
+
+	case EMS_CANCEL_CODE:
+		if (reader_read(&reader, &event, sizeof(struct EventRef)) == 0 &&
+			reader_read(&reader, &reservation_id, sizeof(unsigned int)) == 0 &&
+			ems_cancel(&event, &session->events, reservation_id) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+
+	case EMS_GET_RESERVATION_CODE:
+		if (reader_read(&reader, &event, sizeof(struct EventRef)) != 0 ||
+			reader_read(&reader, &reservation_id, sizeof(unsigned int)) != 0) {
+			buffer_append(resp, &return_value, sizeof(int));
+			break;
+		}
+		ems_get_reservation(resp, &event, &session->events, reservation_id);
+		break;
+
+	case EMS_RESERVE_MULTI_CODE:
+		if (handle_reserve_multi(session, &reader) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+
+	case EMS_RUN_JOBS_CODE:
+		if (handle_run_jobs(session, request, &reader, &respond, &failed) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		if (!respond) {
+			return;
+		}
+		// The output of the script already went out, the final frame only carries the outcome
+		resp->size = 0;
+		last = 1;
+		buffer_append(resp, &last, sizeof(char));
+		buffer_append(resp, &return_value, sizeof(int));
+		buffer_append(resp, &failed, sizeof(size_t));
+		break;
+
+	case EMS_SUBSCRIBE_CODE:
+		if (handle_subscribe(session, request, &reader) == 0) {
+			return_value = SUCCESS_MSG;
+		}
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+
+	case EMS_SHOW_CODE:
+		if (reader_read(&reader, &event_id, sizeof(unsigned int)) != 0) {
+			buffer_append(resp, &return_value, sizeof(int));
+			break;
+		}
+		// Concurrent SHOWs of the event share one response, written by flight_show
+		event = (struct EventRef){event_id, 0, 0};
+		flight_show(session, request, &event, 0);
+		return;
+
+	case EMS_SHOW_SINCE_CODE:
+		if (reader_read(&reader, &event, sizeof(struct EventRef)) != 0 ||
+			reader_read(&reader, &version, sizeof(unsigned int)) != 0) {
+			buffer_append(resp, &return_value, sizeof(int));
+			break;
+		}
+		flight_show(session, request, &event, version);
+		return;
+
+	case EMS_LIST_CODE:
+		handle_list(session, request, resp);
+		break;
+
+	case EMS_LIST_RANGE_CODE:
+		handle_list_range(&reader, resp);
+		break;
+
+	case EMS_SHOW_MANY_CODE:
+		handle_show_many(session, &reader, resp);
+		break;
+
+	case EMS_STATS_CODE:
+		if (reader_read(&reader, &event, sizeof(struct EventRef)) != 0 ||
+			reader_read(&reader, &with_rows, sizeof(char)) != 0) {
+			buffer_append(resp, &return_value, sizeof(int));
+			break;
+		}
+		ems_stats(resp, &event, &session->events, with_rows);
+		break;
+
+	default:
+		buffer_append(resp, &return_value, sizeof(int));
+		break;
+	}
+
+	session_respond(session, request, resp->data, resp->size);
+}
+
 void* client_listener() {
 	while (1) {
 		// Wait for new clients
         int sv_fd = open(server_pipe_path, O_RDONLY);
-		printf("opened, again!\n");
-		sleep(1);
-        
-		sem_wait(&sem_empty);
-        pthread_mutex_lock(&mutex_session);
-        client_buffer[buffer_count].sv_fd = sv_fd;
-		client_buffer[buffer_count].session_id = sessions;
-        buffer_count++;
-		sessions++;
-        pthread_mutex_unlock(&mutex_session);
-        sem_post(&sem_full);
+		if (sv_fd == -1) {
+			fprintf(stderr, "Failed to open the server pipe on path \"%s\".\n", server_pipe_path);
+			continue;
+		}
+
+		// Several clients may write their setup while the pipe is open, so read until every writer is gone
+		struct client_info client;
+		char OP_CODE;
+		while (read_full(sv_fd, &OP_CODE, sizeof(char)) == 0) {
+			if (OP_CODE != EMS_SETUP_CODE) {
+				fprintf(stderr, "Failed to set up the client: code received (%d) wasn't meant for setup.\n", OP_CODE);
+				break;
+			}
+			if (read_full(sv_fd, client.req_pipe_path, sizeof(char) * MAX_PIPENAME_SIZE) != 0 ||
+				read_full(sv_fd, client.resp_pipe_path, sizeof(char) * MAX_PIPENAME_SIZE) != 0 ||
+				read_full(sv_fd, &client.features, sizeof(char)) != 0) {
+				fprintf(stderr, "Failed reading the setup request from the server pipe.\n");
+				break;
+			}
+			client.req_pipe_path[MAX_PIPENAME_SIZE - 1] = '\0';
+			client.resp_pipe_path[MAX_PIPENAME_SIZE - 1] = '\0';
+
+			sem_wait(&sem_empty);
+			pthread_mutex_lock(&mutex_session);
+			client.session_id = sessions;
+			client_buffer[buffer_count] = client;
+			buffer_count++;
+			sessions++;
+			pthread_mutex_unlock(&mutex_session);
+			sem_post(&sem_full);
+		}
 
 		close(sv_fd);
 	}
@@ -122,145 +819,87 @@ void* client_listener() {
 
 void* client_reader() {
 	while (1) {
-		int sv_fd, session_id;
+		struct client_info client;
 		// Remove from the buffer
         sem_wait(&sem_full);
         pthread_mutex_lock(&mutex_session);
-        sv_fd = client_buffer[buffer_count - 1].sv_fd;
-		session_id = client_buffer[buffer_count - 1].session_id;
+        client = client_buffer[buffer_count - 1];
         buffer_count--;
-		fprintf(stderr, "Passed! %d\n", buffer_count);
 
 		pthread_mutex_unlock(&mutex_session);
         sem_post(&sem_empty);
 
-		char OP_CODE;
-		if (read(sv_fd, &OP_CODE, sizeof(char)) == -1) {
-			fprintf(stderr, "Failed to read OP_CODE sent by server. %d\n", session_id);
-		}
-		if (OP_CODE != EMS_SETUP_CODE) {
-			fprintf(stderr, "Failed to set up the client: code received (%d) wasn't meant for setup.\n", OP_CODE);
-		}
-
-		char* req_pipe_path = (char*) malloc(sizeof(char) * MAX_PIPENAME_SIZE);
-		if (read(sv_fd, req_pipe_path, sizeof(char) * MAX_PIPENAME_SIZE) == -1) {
-			fprintf(stderr, "Failed reading the request pipe path from the server pipe. Expected valid path, found %s.\n", req_pipe_path);
-		}
-		char* resp_pipe_path = (char*) malloc(sizeof(char) * MAX_PIPENAME_SIZE);
-		if (read(sv_fd, resp_pipe_path, sizeof(char) * MAX_PIPENAME_SIZE) == -1) {
-			fprintf(stderr, "Failed reading the response pipe path from the server pipe. Expected valid path, found %s.\n", resp_pipe_path);
-		}
-
-		// Required work with sv_fd done
-		close(sv_fd);
+		int session_id = client.session_id;
+		char* req_pipe_path = client.req_pipe_path;
+		char* resp_pipe_path = client.resp_pipe_path;
+		// Only keep the features this server knows how to serve
+		char features = (char)(client.features & EMS_SERVER_FEATURES);
 
 		int req_fd = open(req_pipe_path, O_RDONLY);
 		if (req_fd == -1) {
 			fprintf(stderr, "Failed to open the request pipe on path \"%s\".\n", req_pipe_path);
+			continue;
 		}
 
 		int resp_fd = open(resp_pipe_path, O_WRONLY);
 		if (resp_fd == -1) {
 			fprintf(stderr, "Failed to open the response pipe on path \"%s\".\n", resp_pipe_path);
+			close(req_fd);
+			continue;
 		}
 
     	if (write(resp_fd, &session_id, sizeof(int)) == -1) {
       		fprintf(stderr, "Failed to write the response pipe path on the server pipe.\n");
     	}
+		if (write(resp_fd, &features, sizeof(char)) == -1) {
+			fprintf(stderr, "Failed to write the accepted features on the response pipe.\n");
+		}
 
-		int failed_value = FAIL_MSG;
-		int success_value = SUCCESS_MSG;
-
-		unsigned int event_id;
-		size_t num_seats;
-		size_t num_rows;
-		size_t num_cols;
-		size_t* xs = NULL;
-		size_t* ys = NULL;
+		struct Connection* connection = connection_create(session_id, req_fd, resp_fd, features);
+		if (connection == NULL) {
+			fprintf(stderr, "Failed to allocate memory for connection %d.\n", session_id);
+			close(req_fd);
+			close(resp_fd);
+			continue;
+		}
 
-		int comands = EOC;
-		while (comands) {
-			if (read(req_fd, &OP_CODE, sizeof(char)) == -1) {
-				fprintf(stderr, "Failed reading the OP_CODE (%d).\n", OP_CODE);
-				break;
+		// Frames of every logical session arrive here and are served by the scheduler workers
+		char OP_CODE;
+		int frame_session_id;
+		unsigned int request_id;
+		size_t size;
+		while (read_frame_header(req_fd, &OP_CODE, &frame_session_id, &request_id, &size) == 0) {
+			int failed_value = FAIL_MSG;
+			struct Session* session = connection_get_session(connection, frame_session_id);
+			struct Request* request = malloc(sizeof(struct Request));
+			char* payload = size <= MAX_FRAME_SIZE ? malloc(size > 0 ? size : 1) : NULL;
+
+			if (session == NULL || request == NULL || payload == NULL) {
+				fprintf(stderr, "Failed to queue a request of session %d.\n", frame_session_id);
+				free(request);
+				free(payload);
+				// The payload still has to be drained to reach the next frame
+				discard_request(req_fd, size);
+				pthread_mutex_lock(&connection->write_mutex);
+				write_frame(resp_fd, OP_CODE, frame_session_id, request_id, &failed_value, sizeof(int));
+				pthread_mutex_unlock(&connection->write_mutex);
+				continue;
 			}
-			fprintf(stderr, "Working with OP_CODE %d.\n", OP_CODE);
-			switch (OP_CODE) {
-			case EMS_CREATE_CODE:
-
-				if (read(req_fd, &event_id, sizeof(unsigned int)) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}
-				if (read(req_fd, &num_rows, sizeof(size_t)) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}
-				if (read(req_fd, &num_cols, sizeof(size_t)) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}
-				
-				if (ems_create(event_id, num_rows, num_cols) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}  
-				write(resp_fd, &success_value, sizeof(int));
-				break;
-			
-			case EMS_QUIT_CODE:
-
-				fprintf(stderr, "Ended reading file!\n");
-				close(req_fd);
-				close(resp_fd);
-				comands = 0;
-				break;
-
-			case EMS_RESERVE_CODE:
-
-				if (read(req_fd, &event_id, sizeof(unsigned int)) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}
-				if (read(req_fd, &num_seats, sizeof(size_t)) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}
-
-				xs = (size_t*) malloc(sizeof(size_t) * num_seats);
-				if (read(req_fd, xs, sizeof(size_t) * num_seats) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}
-
-				ys = (size_t*) malloc(sizeof(size_t) * num_seats);
-				if (read(req_fd, ys, sizeof(size_t) * num_seats) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}
-
-				if (ems_reserve(event_id, num_seats, xs, ys) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}
-				write(resp_fd, &success_value, sizeof(int));
-				break;
 
-			case EMS_SHOW_CODE:
-				if (read(req_fd, &event_id, sizeof(unsigned int)) == -1) {
-					write(resp_fd, &failed_value, sizeof(int));
-					break;
-				}
-				ems_show(resp_fd, event_id); 
-				break;
-
-			case EMS_LIST_CODE:
-				ems_list_events(resp_fd);
-				break;
-
-			default:
+			if (read_full(req_fd, payload, size) != 0) {
+				free(request);
+				free(payload);
 				break;
 			}
+
+			request->op = OP_CODE;
+			request->id = request_id;
+			request->payload = payload;
+			request->size = size;
+			session_enqueue(session, request);
 		}
+
+		// The client closed its end, finish what it already asked for and let the pipes go
+		connection_destroy(connection);
 	}
 }
@@ -1,6 +1,7 @@
 #define FAIL_MSG 1
 #define SUCCESS_MSG 0
 #define EOC 1
+#define REQUEST_WORKER_COUNT 4  // Threads serving the requests of every logical session
 
 void* client_listener();
 void* client_reader();
@@ -0,0 +1,208 @@
+#include "notify.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common/constants.h"
+#include "operations.h"
+
+// Subscriptions with notifications waiting to be pushed, oldest first
+static struct Subscription *queue_head = NULL;
+static struct Subscription *queue_tail = NULL;
+static pthread_mutex_t notify_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued_cond = PTHREAD_COND_INITIALIZER;  // Signaled when a subscription is queued
+static pthread_cond_t sent_cond = PTHREAD_COND_INITIALIZER;    // Signaled when a push is done
+
+/// Queues a subscription for the notifier, unless it is already waiting.
+/// @note The notifier lock must be held.
+/// @param subscription Subscription to queue.
+static void push_queued(struct Subscription *subscription) {
+  if (subscription->queued) {
+    return;
+  }
+
+  subscription->queued = 1;
+  subscription->next_queued = NULL;
+  if (queue_tail == NULL) {
+    queue_head = subscription;
+  } else {
+    queue_tail->next_queued = subscription;
+  }
+  queue_tail = subscription;
+  pthread_cond_signal(&queued_cond);
+}
+
+/// Removes a subscription from the notifier queue, if it is there.
+/// @note The notifier lock must be held.
+/// @param subscription Subscription to remove.
+static void remove_queued(struct Subscription *subscription) {
+  if (!subscription->queued) {
+    return;
+  }
+
+  struct Subscription *previous = NULL;
+  struct Subscription *current = queue_head;
+  while (current != subscription) {
+    previous = current;
+    current = current->next_queued;
+  }
+
+  if (previous == NULL) {
+    queue_head = subscription->next_queued;
+  } else {
+    previous->next_queued = subscription->next_queued;
+  }
+  if (queue_tail == subscription) {
+    queue_tail = previous;
+  }
+  subscription->queued = 0;
+}
+
+/// Detaches a subscription from its event and frees it, once the notifier is done with it.
+/// @param subscription Subscription to cancel.
+static void cancel_subscription(struct Subscription *subscription) {
+  // Once detached no commit can queue changes for it, so only the notifier may still hold it
+  if (subscription->event != NULL) {
+    ems_unsubscribe(subscription);
+  }
+
+  pthread_mutex_lock(&notify_mutex);
+  remove_queued(subscription);
+  while (subscription->sending) {
+    pthread_cond_wait(&sent_cond, &notify_mutex);
+  }
+  pthread_mutex_unlock(&notify_mutex);
+
+  buffer_free(&subscription->changes);
+  free(subscription);
+}
+
+void *notify_worker() {
+  struct Buffer frame = {NULL, 0, 0};
+
+  while (1) {
+    pthread_mutex_lock(&notify_mutex);
+    while (queue_head == NULL) {
+      pthread_cond_wait(&queued_cond, &notify_mutex);
+    }
+
+    struct Subscription *subscription = queue_head;
+    queue_head = subscription->next_queued;
+    if (queue_head == NULL) {
+      queue_tail = NULL;
+    }
+    subscription->queued = 0;
+
+    // Everything queued since the last push goes out in one frame, commits keep queueing behind it meanwhile
+    char kind = subscription->dropped ? EMS_NOTIFY_DROPPED : EMS_NOTIFY_CHANGES;
+    size_t num_changes = subscription->dropped ? 0 : subscription->changes.size / (2 * sizeof(unsigned int));
+    frame.size = 0;
+    int result = buffer_append(&frame, &subscription->event_id, sizeof(unsigned int)) ||
+                 buffer_append(&frame, &subscription->version, sizeof(unsigned int)) ||
+                 buffer_append(&frame, &kind, sizeof(char)) || buffer_append(&frame, &num_changes, sizeof(size_t)) ||
+                 (num_changes > 0 &&
+                  buffer_append(&frame, subscription->changes.data, 2 * sizeof(unsigned int) * num_changes));
+
+    subscription->changes.size = 0;
+    subscription->dropped = result != 0;
+    subscription->sending = result == 0;
+    pthread_mutex_unlock(&notify_mutex);
+
+    if (result != 0) {
+      // The client is told to resync with the next push instead
+      fprintf(stderr, "Failed to build a notification for session %d.\n", subscription->session->id);
+      continue;
+    }
+
+    session_push(subscription->session, EMS_NOTIFY_CODE, subscription->request_id, frame.data, frame.size);
+
+    pthread_mutex_lock(&notify_mutex);
+    subscription->sending = 0;
+    pthread_cond_broadcast(&sent_cond);
+    pthread_mutex_unlock(&notify_mutex);
+  }
+}
+
+void notify_event_changed(struct Event *event, size_t num_changes) {
+  if (event->subscribers == NULL) {
+    return;
+  }
+
+  // The changes of the commit are the newest in the log, unless the log lost track of any change since
+  int logged = event->changes_base < event->version && num_changes <= EVENT_CHANGE_LOG_SIZE;
+
+  pthread_mutex_lock(&notify_mutex);
+  for (struct Subscription *subscription = event->subscribers; subscription != NULL;
+       subscription = subscription->next_in_event) {
+    size_t queued = subscription->changes.size / (2 * sizeof(unsigned int));
+    if (!subscription->dropped && (!logged || queued + num_changes > NOTIFY_BACKLOG_SIZE)) {
+      // The client fell too far behind, it gets told to resync instead of an ever-growing backlog
+      subscription->dropped = 1;
+      subscription->changes.size = 0;
+    }
+
+    for (size_t i = event->num_changes - num_changes; !subscription->dropped && i < event->num_changes; i++) {
+      struct SeatChange *change = &event->changes[i % EVENT_CHANGE_LOG_SIZE];
+      if (buffer_append(&subscription->changes, &change->seat, sizeof(unsigned int)) != 0 ||
+          buffer_append(&subscription->changes, &change->reservation_id, sizeof(unsigned int)) != 0) {
+        subscription->dropped = 1;
+        subscription->changes.size = 0;
+      }
+    }
+
+    subscription->version = event->version;
+    push_queued(subscription);
+  }
+  pthread_mutex_unlock(&notify_mutex);
+}
+
+int notify_subscribe(struct Session *session, unsigned int request_id, size_t num_events,
+                     const unsigned int *event_ids) {
+  struct Subscription *added = NULL;
+  struct Subscription *last_added = NULL;
+  int result = 0;
+
+  for (size_t i = 0; result == 0 && i < num_events; i++) {
+    struct Subscription *subscription = calloc(1, sizeof(struct Subscription));
+    if (subscription == NULL) {
+      fprintf(stderr, "Failed to allocate memory for a subscription of session %d.\n", session->id);
+      result = 1;
+      break;
+    }
+
+    subscription->session = session;
+    subscription->request_id = request_id;
+    subscription->event_id = event_ids[i];
+    subscription->next_in_session = added;
+    added = subscription;
+    if (last_added == NULL) {
+      last_added = subscription;
+    }
+
+    result = ems_subscribe(subscription);
+  }
+
+  if (result != 0) {
+    while (added != NULL) {
+      struct Subscription *next = added->next_in_session;
+      cancel_subscription(added);
+      added = next;
+    }
+    return 1;
+  }
+
+  if (last_added != NULL) {
+    last_added->next_in_session = session->subscriptions;
+    session->subscriptions = added;
+  }
+  return 0;
+}
+
+void notify_cancel_all(struct Session *session) {
+  while (session->subscriptions != NULL) {
+    struct Subscription *next = session->subscriptions->next_in_session;
+    cancel_subscription(session->subscriptions);
+    session->subscriptions = next;
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef SERVER_NOTIFY_H
+#define SERVER_NOTIFY_H
+
+#include <stddef.h>
+
+#include "common/io.h"
+#include "eventlist.h"
+#include "session.h"
+
+#define NOTIFY_BACKLOG_SIZE 1024  // Changes queued per subscription before they are dropped for a resync
+
+/// Subscription of a session to the seat changes of one event.
+struct Subscription {
+  struct Session *session;  /// Session the notifications are pushed to.
+  unsigned int request_id;  /// Id of the SUBSCRIBE request, carried by every notification.
+  unsigned int event_id;    /// Event being watched.
+  struct Event *event;      /// Set once the subscription is attached to the event.
+
+  // Protected by the notifier lock
+  struct Buffer changes;  /// (seat, reservation id) pairs not pushed yet, from every commit since the last push.
+  unsigned int version;   /// Event version after the newest queued change.
+  int dropped;            /// Whether changes were dropped since the last push, so the client must resync.
+  int queued;             /// Whether the subscription is waiting for the notifier.
+  int sending;            /// Whether the notifier is pushing this subscription right now.
+  struct Subscription *next_queued;
+
+  struct Subscription *next_in_event;    /// Protected by the event mutex.
+  struct Subscription *next_in_session;  /// Only touched by whoever serves the session.
+};
+
+/// Pushes queued notifications to the clients, forever.
+/// @note A client that stops reading holds up the pushes, but never a RESERVE: queued changes keep being
+///       coalesced per subscription, and dropped once NOTIFY_BACKLOG_SIZE is reached.
+void *notify_worker();
+
+/// Queues the changes of the latest commit of an event for every subscriber.
+/// @note The event mutex must be held.
+/// @param event Event that changed.
+/// @param num_changes Number of seats changed by the commit, the newest entries of the event change log.
+void notify_event_changed(struct Event *event, size_t num_changes);
+
+/// Subscribes a session to the changes of some events.
+/// @note Either every event is subscribed to or none is.
+/// @param session Session the notifications are pushed to.
+/// @param request_id Id of the SUBSCRIBE request.
+/// @param num_events Number of events to subscribe to.
+/// @param event_ids Array of ids of the events.
+/// @return 0 if the session was subscribed, 1 otherwise.
+int notify_subscribe(struct Session *session, unsigned int request_id, size_t num_events,
+                     const unsigned int *event_ids);
+
+/// Cancels every subscription of a session, waiting for pushes in progress to finish.
+/// @param session Session whose subscriptions to cancel.
+void notify_cancel_all(struct Session *session);
+
+#endif  // SERVER_NOTIFY_H
@@ -1,20 +1,47 @@
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 
+#include "common/codec.h"
+#include "common/constants.h"
 #include "common/io.h"
 #include "eventlist.h"
+#include "notify.h"
+#include "operations.h"
+#include "tiering.h"
 
 static struct EventList* event_list = NULL;
 static unsigned int state_access_delay_us = 0;
 
+// Table of events addressed by handles, only grown under the list write lock. Chunks never move once
+// allocated and a slot is filled before the count covers it, so slots can be read without the lock.
+static struct Event** event_slot_chunks[EVENT_SLOT_CHUNKS];
+// Ids of the events in slot order, which is also creation and list order, so LIST reads them without the lock
+static unsigned int* event_id_chunks[EVENT_SLOT_CHUNKS];
+static atomic_size_t num_event_slots = 0;
+static unsigned int next_generation = 1;
+
+/// Venue that events can be created from, sharing its grid until they reserve seats.
+struct Template {
+  unsigned int id;
+  int fd;              /// Shared memory object with the grid, mapped copy-on-write by every event created from it.
+  struct Event event;  /// Dimensions and counters copied into every event created from it, without a grid of its own.
+  struct Template* next;
+};
+
+// Templates are never removed, so a template found stays valid until the state is destroyed
+static struct Template* templates = NULL;
+static pthread_mutex_t templates_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory resource.
 /// @param event_id The ID of the event to get.
@@ -36,6 +63,348 @@ static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode
 /// @return Index of the seat.
 static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
 
+/// Locks an event for an operation on its seats, reading its grid back first if it was spilled.
+/// @param event Event to lock.
+/// @return 0 if the event is locked with its grid in memory, 1 otherwise, with the event unlocked.
+static int lock_event(struct Event* event) {
+  if (pthread_mutex_lock(&event->mutex) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
+  }
+  if (tiering_load(event) != 0) {
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+  return 0;
+}
+
+/// Looks up an event in the state, taking the list read lock for the duration of the search.
+/// @param event_id The ID of the event to get.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* find_event(unsigned int event_id) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return NULL;
+  }
+
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return NULL;
+  }
+
+  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  pthread_rwlock_unlock(&event_list->rwl);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+  }
+  return event;
+}
+
+/// Id of an event being looked up, along with where the event found goes.
+struct IdPosition {
+  unsigned int id;
+  size_t position;
+};
+
+/// Compares two ids being looked up, for qsort.
+static int compare_id_positions(const void* a, const void* b) {
+  unsigned int id_a = ((const struct IdPosition*)a)->id;
+  unsigned int id_b = ((const struct IdPosition*)b)->id;
+  return (id_a > id_b) - (id_a < id_b);
+}
+
+/// Looks up several events in a single pass over the state, paying the lookup delay once.
+/// @param num_events Number of events to look up.
+/// @param event_ids Array of ids of the events, which may repeat.
+/// @param events Array to store the events in, NULL for the ones not found.
+/// @return 0 if the state could be searched, 1 otherwise.
+static int find_events(size_t num_events, const unsigned int* event_ids, struct Event** events) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  // The ids are sorted, so each event of the list is matched with a binary search
+  struct IdPosition* sorted = malloc(sizeof(struct IdPosition) * (num_events > 0 ? num_events : 1));
+  if (sorted == NULL) {
+    fprintf(stderr, "Error allocating memory for the lookup\n");
+    return 1;
+  }
+  for (size_t i = 0; i < num_events; i++) {
+    sorted[i] = (struct IdPosition){event_ids[i], i};
+    events[i] = NULL;
+  }
+  qsort(sorted, num_events, sizeof(struct IdPosition), compare_id_positions);
+
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    free(sorted);
+    return 1;
+  }
+
+  struct timespec delay = {0, state_access_delay_us * 1000};
+  nanosleep(&delay, NULL);  // Should not be removed
+
+  for (struct ListNode* node = event_list->head; node != NULL; node = node == event_list->tail ? NULL : node->next) {
+    size_t low = 0;
+    size_t high = num_events;
+    while (low < high) {
+      size_t middle = low + (high - low) / 2;
+      if (sorted[middle].id < node->event->id) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+
+    for (; low < num_events && sorted[low].id == node->event->id; low++) {
+      events[sorted[low].position] = node->event;
+    }
+  }
+
+  pthread_rwlock_unlock(&event_list->rwl);
+  free(sorted);
+  return 0;
+}
+
+/// Gets the event a handle points to, without the lookup delay or the list lock.
+/// @param ref Handle to the event.
+/// @return Pointer to the event, NULL if the handle is stale.
+static struct Event* event_from_handle(const struct EventRef* ref) {
+  if (ref->slot >= atomic_load_explicit(&num_event_slots, memory_order_acquire)) {
+    return NULL;
+  }
+
+  struct Event* event = event_slot_chunks[ref->slot / EVENT_SLOT_CHUNK_SIZE][ref->slot % EVENT_SLOT_CHUNK_SIZE];
+  if (event->generation != ref->generation || event->id != ref->id) {
+    return NULL;
+  }
+  return event;
+}
+
+/// Remembers an event as the most recently used one of a cache, evicting the least recently used if it is full.
+/// @param cache Cache of the session.
+/// @param event Event to remember.
+/// @param position Position of the event in the cache, EVENT_CACHE_SIZE if it is not there.
+static void cache_event(struct EventCache* cache, const struct Event* event, size_t position) {
+  size_t last = position < EVENT_CACHE_SIZE ? position : EVENT_CACHE_SIZE - 1;
+  memmove(&cache->entries[1], &cache->entries[0], sizeof(struct EventRef) * last);
+  cache->entries[0] = (struct EventRef){event->id, event->slot, event->generation};
+}
+
+/// Gets an event by handle, from the session cache, or looks it up by id as a last resort.
+/// @param ref The event as addressed by the request.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @return Pointer to the event if found, NULL if it does not exist or the handle is stale.
+static struct Event* find_event_ref(const struct EventRef* ref, struct EventCache* cache) {
+  if (ref->generation != 0) {
+    struct Event* event = event_from_handle(ref);
+    if (event == NULL) {
+      fprintf(stderr, "Stale event handle\n");
+    }
+    return event;
+  }
+
+  if (cache == NULL) {
+    return find_event(ref->id);
+  }
+
+  size_t position = 0;
+  while (position < EVENT_CACHE_SIZE &&
+         (cache->entries[position].generation == 0 || cache->entries[position].id != ref->id)) {
+    position++;
+  }
+
+  // An entry left behind by an event that went away is dropped and looked up again
+  struct Event* event = position < EVENT_CACHE_SIZE ? event_from_handle(&cache->entries[position]) : NULL;
+  if (event != NULL) {
+    cache->hits++;
+  } else {
+    cache->misses++;
+    event = find_event(ref->id);
+  }
+
+  if (event != NULL) {
+    cache_event(cache, event, position);
+  } else if (position < EVENT_CACHE_SIZE) {
+    cache->entries[position].generation = 0;
+  }
+  return event;
+}
+
+/// Fills in a handle to an event.
+/// @param event Event the handle points to.
+/// @param ref Pointer to store the handle in.
+static void make_event_ref(const struct Event* event, struct EventRef* ref) {
+  ref->id = event->id;
+  ref->slot = event->slot;
+  ref->generation = event->generation;
+}
+
+/// Finds the longest run of free seats in a row again.
+/// @note The event mutex must be held.
+/// @param event Event the row belongs to.
+/// @param row Row to scan.
+static void scan_free_run(struct Event* event, size_t row) {
+  const unsigned int* seats = &event->data[seat_index(event, row, 1)];
+  struct FreeRun longest = {1, 0};
+  size_t start = 0;
+  for (size_t col = 0; col <= event->cols; col++) {
+    if (col == event->cols || seats[col] != 0) {
+      if (col - start > longest.length) {
+        longest = (struct FreeRun){start + 1, col - start};
+      }
+      start = col + 1;
+    }
+  }
+  event->free_runs[row - 1] = longest;
+}
+
+/// Keeps the longest free run of a row up to date once some of its seats are taken.
+/// @note The event mutex must be held. Taking seats outside the longest run can't change it, so the row is only
+///       scanned when they overlap, and once every seat of the row is taken it won't be scanned again.
+/// @param event Event the row belongs to.
+/// @param row Row whose seats were taken.
+/// @param first_col First column taken.
+/// @param last_col Last column taken.
+static void take_free_run(struct Event* event, size_t row, size_t first_col, size_t last_col) {
+  const struct FreeRun* run = &event->free_runs[row - 1];
+  if (first_col < run->start + run->length && last_col >= run->start) {
+    scan_free_run(event, row);
+  }
+}
+
+/// Makes room in the reservation index for a new reservation, so committing it can't fail halfway.
+/// @note The event mutex must be held.
+/// @param event Event the reservation is for.
+/// @param num_seats Number of seats of the reservation.
+/// @return 0 if there is room, 1 otherwise.
+static int reserve_index_room(struct Event* event, size_t num_seats) {
+  size_t seats_size = event->reservation_seats.size;
+  size_t index_size = event->reservation_index.size;
+  int result = buffer_extend(&event->reservation_seats, sizeof(unsigned int) * num_seats) == NULL ||
+               buffer_extend(&event->reservation_index, sizeof(struct ReservationSeats)) == NULL;
+
+  // Only the room is kept, the commit appends within it
+  event->reservation_seats.size = seats_size;
+  event->reservation_index.size = index_size;
+  if (result != 0) {
+    fprintf(stderr, "Error allocating memory for the reservation index\n");
+  }
+  return result;
+}
+
+/// Adds a seat to the reservation being committed.
+/// @note The event mutex must be held, and reserve_index_room called for the reservation.
+/// @param event Event the seat belongs to.
+/// @param seat Index of the seat.
+static void index_seat(struct Event* event, size_t seat) {
+  unsigned int index = (unsigned int)seat;
+  buffer_append(&event->reservation_seats, &index, sizeof(unsigned int));
+}
+
+/// Closes the reservation being committed, whose seats are the last ones indexed.
+/// @note The event mutex must be held, and reserve_index_room called for the reservation.
+/// @param event Event the reservation is for.
+/// @param num_seats Number of seats of the reservation.
+static void index_reservation(struct Event* event, size_t num_seats) {
+  struct ReservationSeats entry = {event->reservation_seats.size / sizeof(unsigned int) - num_seats, num_seats};
+  buffer_append(&event->reservation_index, &entry, sizeof(struct ReservationSeats));
+}
+
+/// Finds the seats of a reservation in the index.
+/// @note The event mutex must be held.
+/// @param event Event the reservation is for.
+/// @param reservation_id Id of the reservation.
+/// @return The seats of the reservation, NULL if there is no such reservation or it was cancelled.
+static struct ReservationSeats* find_reservation(struct Event* event, unsigned int reservation_id) {
+  if (reservation_id == 0 || reservation_id > event->reservations) {
+    fprintf(stderr, "Reservation not found\n");
+    return NULL;
+  }
+
+  struct ReservationSeats* entry = (struct ReservationSeats*)event->reservation_index.data + reservation_id - 1;
+  if (entry->count == 0) {
+    fprintf(stderr, "Reservation was cancelled\n");
+    return NULL;
+  }
+  return entry;
+}
+
+/// Records a seat change in the event change log, dropping the oldest change when the log is full.
+/// @note The event mutex must be held.
+/// @param event Event whose seat changed.
+/// @param seat Index of the seat that changed.
+/// @param reservation_id New value of the seat.
+static void log_seat_change(struct Event* event, size_t seat, unsigned int reservation_id) {
+  if (event->changes == NULL) {
+    event->changes = malloc(sizeof(struct SeatChange) * EVENT_CHANGE_LOG_SIZE);
+    if (event->changes == NULL) {
+      // Without a log no older version can be served as a delta
+      event->changes_base = event->version;
+      return;
+    }
+  }
+
+  struct SeatChange* change = &event->changes[event->num_changes % EVENT_CHANGE_LOG_SIZE];
+  if (event->num_changes >= EVENT_CHANGE_LOG_SIZE && change->version > event->changes_base) {
+    event->changes_base = change->version;
+  }
+
+  change->version = event->version;
+  change->seat = (unsigned int)seat;
+  change->reservation_id = reservation_id;
+  event->num_changes++;
+}
+
+/// Writes a failed return value to the response.
+/// @param resp Response being built.
+/// @return Always 1, so callers can return it directly.
+static int write_failure(struct Buffer* resp) {
+  int return_value = 1;
+  resp->size = 0;
+  if (buffer_append(resp, &return_value, sizeof(int)) != 0) {
+    fprintf(stderr, "Failed to write the return value to the response.\n");
+  }
+  return 1;
+}
+
+/// Writes a seat grid to the response, using the encoding negotiated by the session.
+/// @param resp Response being built.
+/// @param seats Array of seats to write.
+/// @param num_seats Number of seats in the array.
+/// @param features Features negotiated by the session.
+/// @return 0 if the seats were written successfully, 1 otherwise.
+static int write_seats(struct Buffer* resp, const unsigned int* seats, size_t num_seats, char features) {
+  if (!(features & EMS_FEATURE_SHOW_RLE)) {
+    return buffer_append(resp, seats, sizeof(unsigned int) * num_seats);
+  }
+
+  // Compress only when the grid is large enough to be worth it, and fall back to raw if it does not shrink
+  char encoding = EMS_SHOW_ENCODING_RLE;
+  if (sizeof(unsigned int) * num_seats >= EMS_SHOW_RLE_THRESHOLD) {
+    size_t header = resp->size;
+    size_t capacity = sizeof(unsigned int) * num_seats;
+    if (buffer_append(resp, &encoding, sizeof(char)) != 0 || buffer_extend(resp, sizeof(size_t) + capacity) == NULL) {
+      return 1;
+    }
+
+    unsigned char* encoded = (unsigned char*)resp->data + header + sizeof(char) + sizeof(size_t);
+    size_t encoded_size = rle_encode(seats, num_seats, encoded, capacity);
+    if (encoded_size > 0) {
+      memcpy(resp->data + header + sizeof(char), &encoded_size, sizeof(size_t));
+      resp->size = header + sizeof(char) + sizeof(size_t) + encoded_size;
+      return 0;
+    }
+    resp->size = header;
+  }
+
+  encoding = EMS_SHOW_ENCODING_RAW;
+  return buffer_append(resp, &encoding, sizeof(char)) ||
+         buffer_append(resp, seats, sizeof(unsigned int) * num_seats);
+}
+
 int ems_init(unsigned int delay_us) {
   if (event_list != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
@@ -60,11 +429,132 @@ int ems_terminate() {
   }
 
   free_list(event_list);
+  for (size_t i = 0; i < EVENT_SLOT_CHUNKS; i++) {
+    free(event_slot_chunks[i]);
+    free(event_id_chunks[i]);
+    event_slot_chunks[i] = NULL;
+    event_id_chunks[i] = NULL;
+  }
+  atomic_store(&num_event_slots, 0);
   pthread_rwlock_unlock(&event_list->rwl);
+
+  // The events mapping the templates are gone, so the templates can go too
+  pthread_mutex_lock(&templates_mutex);
+  while (templates != NULL) {
+    struct Template* template = templates;
+    templates = template->next;
+    close(template->fd);
+    free(template->event.row_reserved);
+    free(template->event.free_runs);
+    buffer_free(&template->event.reservation_seats);
+    buffer_free(&template->event.reservation_index);
+    free(template);
+  }
+  pthread_mutex_unlock(&templates_mutex);
+  return 0;
+}
+
+/// Checks that the arrays of a batch of events with the same dimensions can be sized without overflowing.
+/// @note The dimensions come straight off the wire, a wrapped size would give grids smaller than the seats indexed.
+/// @param num_events Number of events in the batch.
+/// @param num_rows Number of rows of each event.
+/// @param num_cols Number of columns of each event.
+/// @return 0 if the dimensions are valid, 1 otherwise.
+static int check_dimensions(size_t num_events, size_t num_rows, size_t num_cols) {
+  size_t max_rows = SIZE_MAX / sizeof(struct FreeRun) / num_events;
+  if (num_rows == 0 || num_cols == 0 || num_rows > max_rows ||
+      num_cols > SIZE_MAX / sizeof(unsigned int) / num_events / num_rows) {
+    fprintf(stderr, "Invalid event dimensions\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Makes sure the table of events addressed by handles has room for some new events.
+/// @note The list write lock must be held.
+/// @param first_slot First slot to be filled, the current number of slots.
+/// @param num_slots Number of slots to be filled.
+/// @return 0 if there is room, 1 otherwise.
+static int grow_event_slots(size_t first_slot, size_t num_slots) {
+  if (num_slots > EVENT_SLOT_CHUNKS * EVENT_SLOT_CHUNK_SIZE - first_slot) {
+    fprintf(stderr, "Too many events\n");
+    return 1;
+  }
+
+  for (size_t i = first_slot / EVENT_SLOT_CHUNK_SIZE; i * EVENT_SLOT_CHUNK_SIZE < first_slot + num_slots; i++) {
+    struct Event*** chunk = &event_slot_chunks[i];
+    unsigned int** ids = &event_id_chunks[i];
+    if ((*chunk == NULL && (*chunk = malloc(sizeof(struct Event*) * EVENT_SLOT_CHUNK_SIZE)) == NULL) ||
+        (*ids == NULL && (*ids = malloc(sizeof(unsigned int) * EVENT_SLOT_CHUNK_SIZE)) == NULL)) {
+      fprintf(stderr, "Error allocating memory for event slots\n");
+      return 1;
+    }
+  }
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+/// Fills in a new event, whose grid arrays are already allocated, except for its place in the table.
+/// @param event Event to fill in.
+/// @param event_id Id of the event.
+/// @param num_rows Number of rows of the event.
+/// @param num_cols Number of columns of the event.
+/// @return 0 if the event was filled in successfully, 1 otherwise.
+static int prepare_event(struct Event* event, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  event->id = event_id;
+  event->rows = num_rows;
+  event->cols = num_cols;
+  event->reservations = 0;
+  event->version = 1;
+  event->changes = NULL;
+  event->num_changes = 0;
+  event->changes_base = event->version;
+  event->subscribers = NULL;
+  event->reserved_seats = 0;
+  event->reservation_seats = (struct Buffer){NULL, 0, 0};
+  event->reservation_index = (struct Buffer){NULL, 0, 0};
+
+  for (size_t row = 0; row < num_rows; row++) {
+    event->free_runs[row] = (struct FreeRun){1, num_cols};
+  }
+  return pthread_mutex_init(&event->mutex, NULL) != 0;
+}
+
+/// Gives a new event its slot in the table addressed by handles and the next generation.
+/// @note The list write lock must be held.
+/// @param event Event to place.
+/// @param slot Slot of the event.
+static void place_event(struct Event* event, size_t slot) {
+  event->slot = (unsigned int)slot;
+  event->generation = next_generation++;
+  // Generation 0 is left for requests without a handle
+  if (next_generation == 0) {
+    next_generation = 1;
+  }
+}
+
+/// Fills in a new event, whose grid arrays are already allocated.
+/// @note The list write lock must be held, since the event takes the next generation.
+/// @param event Event to fill in.
+/// @param event_id Id of the event.
+/// @param num_rows Number of rows of the event.
+/// @param num_cols Number of columns of the event.
+/// @param slot Slot of the event in the table addressed by handles.
+/// @return 0 if the event was filled in successfully, 1 otherwise.
+static int init_event(struct Event* event, unsigned int event_id, size_t num_rows, size_t num_cols, size_t slot) {
+  place_event(event, slot);
+  return prepare_event(event, event_id, num_rows, num_cols);
+}
+
+/// Puts a new event in its slot of the table addressed by handles.
+/// @note The list write lock must be held, the slot is only seen once the number of slots is updated.
+/// @param event Event to publish.
+static void publish_event(struct Event* event) {
+  tiering_track(event);
+  event_slot_chunks[event->slot / EVENT_SLOT_CHUNK_SIZE][event->slot % EVENT_SLOT_CHUNK_SIZE] = event;
+  event_id_chunks[event->slot / EVENT_SLOT_CHUNK_SIZE][event->slot % EVENT_SLOT_CHUNK_SIZE] = event->id;
+}
+
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols, struct EventRef* created) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
@@ -81,6 +571,12 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
+  size_t slot = atomic_load_explicit(&num_event_slots, memory_order_relaxed);
+  if (grow_event_slots(slot, 1) != 0) {
+    pthread_rwlock_unlock(&event_list->rwl);
+    return 1;
+  }
+
   struct Event* event = malloc(sizeof(struct Event));
 
   if (event == NULL) {
@@ -89,20 +585,21 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  if (pthread_mutex_init(&event->mutex, NULL) != 0) {
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
-    return 1;
-  }
   event->data = calloc(num_rows * num_cols, sizeof(unsigned int));
+  event->row_reserved = calloc(num_rows, sizeof(size_t));
+  event->free_runs = malloc(sizeof(struct FreeRun) * (num_rows > 0 ? num_rows : 1));
+  event->shares_grid = 0;
+  event->arena = NULL;
+  event->mapped_size = 0;
+  event->copied = NULL;
 
-  if (event->data == NULL) {
+  if (event->data == NULL || event->row_reserved == NULL || event->free_runs == NULL ||
+      init_event(event, event_id, num_rows, num_cols, slot) != 0) {
     fprintf(stderr, "Error allocating memory for event data\n");
     pthread_rwlock_unlock(&event_list->rwl);
+    free(event->data);
+    free(event->row_reserved);
+    free(event->free_runs);
     free(event);
     return 1;
   }
@@ -111,254 +608,1287 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     fprintf(stderr, "Error appending event to list\n");
     pthread_rwlock_unlock(&event_list->rwl);
     free(event->data);
+    free(event->row_reserved);
+    free(event->free_runs);
     free(event);
     return 1;
   }
 
+  // The slot is filled before it is counted, so readers without the lock never see it empty
+  publish_event(event);
+  atomic_store_explicit(&num_event_slots, slot + 1, memory_order_release);
+  if (created != NULL) {
+    make_event_ref(event, created);
+  }
+
   pthread_rwlock_unlock(&event_list->rwl);
   return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  
+/// Compares two event ids, for qsort and bsearch.
+static int compare_event_ids(const void* a, const void* b) {
+  unsigned int id_a = *(const unsigned int*)a;
+  unsigned int id_b = *(const unsigned int*)b;
+  return (id_a > id_b) - (id_a < id_b);
+}
+
+/// Frees the events of a bulk creation that failed.
+/// @param events Array of zeroed events, NULL for the ones that were never allocated.
+/// @param num_events Number of events.
+static void free_created_events(struct Event** events, size_t num_events) {
+  for (size_t i = 0; events != NULL && i < num_events; i++) {
+    if (events[i] != NULL && events[i]->mapped_size > 0) {
+      munmap(events[i]->data, events[i]->mapped_size);
+      free(events[i]->copied);
+    }
+    if (events[i] != NULL) {
+      buffer_free(&events[i]->reservation_seats);
+      buffer_free(&events[i]->reservation_index);
+    }
+    free(events[i]);
+  }
+  free(events);
+}
+
+/// Frees the grid arena of a bulk creation that failed.
+/// @param arena Arena to free, NULL if the grids were mapped from a template or never allocated.
+static void free_grid_arena(struct GridArena* arena) {
+  if (arena != NULL) {
+    free(arena->data);
+    free(arena);
+  }
+}
+
+/// Finds a template.
+/// @param template_id Id of the template.
+/// @return The template, NULL if there is none with that id.
+static struct Template* find_template(unsigned int template_id) {
+  pthread_mutex_lock(&templates_mutex);
+  struct Template* template = templates;
+  while (template != NULL && template->id != template_id) {
+    template = template->next;
+  }
+  pthread_mutex_unlock(&templates_mutex);
+  return template;
+}
+
+/// Copies the counters and pre-blocked seats of a template into a new event, whose grid maps the template's.
+/// @note The event must be initialized already.
+/// @param event Event created from the template.
+/// @param template Template of the event.
+/// @return 0 if the event was filled in successfully, 1 otherwise.
+static int copy_template(struct Event* event, const struct Template* template) {
+  const struct Event* venue = &template->event;
+  memcpy(event->row_reserved, venue->row_reserved, sizeof(size_t) * venue->rows);
+  memcpy(event->free_runs, venue->free_runs, sizeof(struct FreeRun) * venue->rows);
+  event->reserved_seats = venue->reserved_seats;
+  event->reservations = venue->reservations;
+  return venue->reservations > 0 &&
+         (buffer_append(&event->reservation_seats, venue->reservation_seats.data, venue->reservation_seats.size) ||
+          buffer_append(&event->reservation_index, venue->reservation_index.data, venue->reservation_index.size));
+}
+
+/// Creates several events with the same dimensions at once, either all of them or none.
+/// @param num_events Number of events to be created.
+/// @param event_ids Array of ids of the events to be created.
+/// @param num_rows Number of rows of each event.
+/// @param num_cols Number of columns of each event.
+/// @param template Template the events map their grids from, NULL to give them zeroed grids of their own.
+/// @return 0 if the events were created successfully, 1 otherwise.
+static int create_events(size_t num_events, const unsigned int* event_ids, size_t num_rows, size_t num_cols,
+                         const struct Template* template) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    return 1;
+  // The first event owns the arenas, so there must be one
+  if (num_events == 0) {
+    return 0;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
-
-  pthread_rwlock_unlock(&event_list->rwl);
-
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
+  if (check_dimensions(num_events, num_rows, num_cols) != 0) {
     return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
+  // The new ids are sorted once, which catches repeats among them and lets the list be checked in one pass
+  unsigned int* sorted = malloc(sizeof(unsigned int) * num_events);
+  if (sorted == NULL) {
+    fprintf(stderr, "Error allocating memory for the event ids\n");
     return 1;
   }
-  printf("num seats -> %ld", num_seats);
-  for (size_t i = 0; i < num_seats; i++) {
-    printf("xs[i] -> %ld, ys[i] -> %ld\n", xs[i], ys[i]);
-    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
-      fprintf(stderr, "Seat out of bounds\n");
-      pthread_mutex_unlock(&event->mutex);
+  memcpy(sorted, event_ids, sizeof(unsigned int) * num_events);
+  qsort(sorted, num_events, sizeof(unsigned int), compare_event_ids);
+  for (size_t i = 1; i < num_events; i++) {
+    if (sorted[i] == sorted[i - 1]) {
+      fprintf(stderr, "Event already exists\n");
+      free(sorted);
       return 1;
     }
   }
 
-  for (size_t i = 0; i < event->rows * event->cols; i++) {
-    for (size_t j = 0; j < num_seats; j++) {
-      if (seat_index(event, xs[j], ys[j]) != i) {
-        continue;
-      }
-
-      if (event->data[i] != 0) {
-        fprintf(stderr, "Seat already reserved\n");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
+  // Every grid comes out of the same arenas, or maps the template's, before the lock is taken
+  size_t grid_size = num_rows * num_cols;
+  struct GridArena* arena = template == NULL ? malloc(sizeof(struct GridArena)) : NULL;
+  if (arena != NULL) {
+    arena->size = sizeof(unsigned int) * num_events * grid_size;
+    arena->data = calloc(num_events * grid_size > 0 ? num_events * grid_size : 1, sizeof(unsigned int));
+    arena->users = num_events;
+  }
+  size_t* row_reserved = calloc(num_events * num_rows > 0 ? num_events * num_rows : 1, sizeof(size_t));
+  struct FreeRun* free_runs = malloc(sizeof(struct FreeRun) * (num_events * num_rows > 0 ? num_events * num_rows : 1));
+  struct Event** events = calloc(num_events, sizeof(struct Event*));
+  int result = (template == NULL && (arena == NULL || arena->data == NULL)) || row_reserved == NULL ||
+               free_runs == NULL || events == NULL;
+  for (size_t i = 0; result == 0 && i < num_events; i++) {
+    result = (events[i] = calloc(1, sizeof(struct Event))) == NULL;
+    if (result == 0 && template != NULL) {
+      // Pages of the grid stay shared with the template until a reservation writes to them
+      size_t size = sizeof(unsigned int) * grid_size;
+      void* grid = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, template->fd, 0);
+      result = grid == MAP_FAILED;
+      if (result == 0) {
+        events[i]->data = grid;
+        events[i]->mapped_size = size;
+        result = tiering_track_mapping(events[i]);
       }
-
-      break;
     }
   }
 
-  unsigned int reservation_id = ++event->reservations;
+  if (result != 0) {
+    fprintf(stderr, "Error allocating memory for events\n");
+    free_created_events(events, num_events);
+    free_grid_arena(arena);
+    free(row_reserved);
+    free(free_runs);
+    free(sorted);
+    return 1;
+  }
 
-  for (size_t i = 0; i < num_seats; i++) {
-    event->data[seat_index(event, xs[i], ys[i])] = reservation_id;
+  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    free_created_events(events, num_events);
+    free_grid_arena(arena);
+    free(row_reserved);
+    free(free_runs);
+    free(sorted);
+    return 1;
   }
 
-  pthread_mutex_unlock(&event->mutex);
-  return 0;
-}
+  struct timespec delay = {0, state_access_delay_us * 1000};
+  nanosleep(&delay, NULL);  // Should not be removed
 
-int ems_show(int resp_fd, unsigned int event_id) {
-  int return_value = 0;
+  for (struct ListNode* node = event_list->head; result == 0 && node != NULL;
+       node = node == event_list->tail ? NULL : node->next) {
+    if (bsearch(&node->event->id, sorted, num_events, sizeof(unsigned int), compare_event_ids) != NULL) {
+      fprintf(stderr, "Event already exists\n");
+      result = 1;
+    }
+  }
 
-  if (event_list == NULL) {
-    fprintf(stderr, "EMS state must be initialized\n");
-    return_value = 1;
-    
-    if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-      perror("Failed to write the return value to the response pipe.\n");
-      pthread_rwlock_unlock(&event_list->rwl);
-      return 1;
+  size_t slot = atomic_load_explicit(&num_event_slots, memory_order_relaxed);
+  result = result || grow_event_slots(slot, num_events);
+  for (size_t i = 0; result == 0 && i < num_events; i++) {
+    struct Event* event = events[i];
+    if (template == NULL) {
+      event->data = arena->data + i * grid_size;
+      event->arena = arena;
     }
-    return 1;
+    event->row_reserved = row_reserved + i * num_rows;
+    event->free_runs = free_runs + i * num_rows;
+    event->shares_grid = i > 0;
+    result = init_event(event, event_ids[i], num_rows, num_cols, slot + i) ||
+             (template != NULL && copy_template(event, template) != 0);
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    return_value = 1;
-    if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-      perror("Failed to write the return value to the response pipe.\n");
-      pthread_rwlock_unlock(&event_list->rwl);
-      return 1;
+  if (result != 0 || append_all_to_list(event_list, events, num_events) != 0) {
+    if (result == 0) {
+      fprintf(stderr, "Error appending event to list\n");
     }
+    pthread_rwlock_unlock(&event_list->rwl);
+    free_created_events(events, num_events);
+    free_grid_arena(arena);
+    free(row_reserved);
+    free(free_runs);
+    free(sorted);
     return 1;
   }
- 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+
+  // The slots are filled before they are counted, so readers without the lock never see them empty
+  if (arena != NULL) {
+    tiering_track_shared(arena->size);
+  }
+  for (size_t i = 0; i < num_events; i++) {
+    publish_event(events[i]);
+  }
+  atomic_store_explicit(&num_event_slots, slot + num_events, memory_order_release);
 
   pthread_rwlock_unlock(&event_list->rwl);
+  free(events);
+  free(sorted);
+  return 0;
+}
 
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
-    return_value = 1;
-    if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-      perror("Failed to write the return value to the response pipe.\n");
-      pthread_rwlock_unlock(&event_list->rwl);
-      return 1;
-    }
+int ems_create_many(size_t num_events, const unsigned int* event_ids, size_t num_rows, size_t num_cols) {
+  return create_events(num_events, event_ids, num_rows, num_cols, NULL);
+}
+
+int ems_create_template(unsigned int template_id, size_t num_rows, size_t num_cols, size_t num_blocked, size_t* xs,
+                        size_t* ys) {
+  if (check_dimensions(1, num_rows, num_cols) != 0 || num_blocked > num_rows * num_cols) {
+    fprintf(stderr, "Invalid template dimensions\n");
     return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    return_value = 1;
-    if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-      perror("Failed to write the return value to the response pipe.\n");
-      pthread_rwlock_unlock(&event_list->rwl);
+  for (size_t i = 0; i < num_blocked; i++) {
+    if (xs[i] <= 0 || xs[i] > num_rows || ys[i] <= 0 || ys[i] > num_cols) {
+      fprintf(stderr, "Invalid seat\n");
       return 1;
     }
-    return 1;
   }
 
-  size_t num_rows = event->rows;
-  size_t num_cols = event->cols;
-  unsigned int* seats = (unsigned int*) malloc(sizeof(unsigned int) * (num_rows * num_cols));
-
-  // FIXME memcpy?
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      seats[seat_index(event, i, j)] = event->data[seat_index(event, i, j)];
-    }
+  struct Template* template = calloc(1, sizeof(struct Template));
+  if (template == NULL) {
+    fprintf(stderr, "Error allocating memory for template\n");
+    return 1;
   }
-  // memcpy(seats, event->data, sizeof(unsigned int) * (num_rows * num_cols));
 
-  if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-    perror("Failed to write the return value to the response pipe.\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    return 1;
+  pthread_mutex_lock(&templates_mutex);
+  struct Template* existing = templates;
+  while (existing != NULL && existing->id != template_id) {
+    existing = existing->next;
   }
-  if (write(resp_fd, &num_rows, sizeof(size_t)) == -1) {
-    perror("Failed to write the number of rows on the response pipe.\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+  if (existing != NULL) {
+    pthread_mutex_unlock(&templates_mutex);
+    fprintf(stderr, "Template already exists\n");
+    free(template);
     return 1;
   }
-  if (write(resp_fd, &num_cols, sizeof(size_t)) == -1) {
-    perror("Failed to write the number of cols on the response pipe.\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    return 1;
+
+  // The object is unlinked right away, it lives on through the descriptor and the mappings of the events
+  char name[64];
+  snprintf(name, sizeof(name), "/ems-template-%ld-%u", (long)getpid(), template_id);
+  template->fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+  if (template->fd != -1) {
+    shm_unlink(name);
   }
 
-  if (write(resp_fd, seats, sizeof(unsigned int) * (num_rows * num_cols)) == -1) {
-    perror("Failed to write the seats on the response pipe.\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+  struct Event* venue = &template->event;
+  size_t size = sizeof(unsigned int) * num_rows * num_cols;
+  venue->rows = num_rows;
+  venue->cols = num_cols;
+  venue->row_reserved = calloc(num_rows, sizeof(size_t));
+  venue->free_runs = malloc(sizeof(struct FreeRun) * num_rows);
+  venue->data = MAP_FAILED;
+  int result = template->fd == -1 || ftruncate(template->fd, (off_t)size) != 0 || venue->row_reserved == NULL ||
+               venue->free_runs == NULL ||
+               (venue->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, template->fd, 0)) == MAP_FAILED ||
+               (num_blocked > 0 && reserve_index_room(venue, num_blocked) != 0);
+  if (result != 0) {
+    fprintf(stderr, "Error allocating memory for template data\n");
+  }
+
+  // Pre-blocked seats are reservation 1 of every event created from the template
+  for (size_t i = 0; result == 0 && i < num_blocked; i++) {
+    size_t seat = seat_index(venue, xs[i], ys[i]);
+    if (venue->data[seat] != 0) {
+      fprintf(stderr, "Seat blocked twice\n");
+      result = 1;
+      break;
+    }
+    venue->data[seat] = 1;
+    venue->row_reserved[xs[i] - 1]++;
+    index_seat(venue, seat);
+  }
+
+  if (result == 0) {
+    for (size_t row = 1; row <= num_rows; row++) {
+      venue->free_runs[row - 1] = (struct FreeRun){1, num_cols};
+      if (venue->row_reserved[row - 1] > 0) {
+        scan_free_run(venue, row);
+      }
+    }
+    if (num_blocked > 0) {
+      index_reservation(venue, num_blocked);
+      venue->reservations = 1;
+      venue->reserved_seats = num_blocked;
+    }
+  }
+
+  // Only the events write to the grid from now on, each to its own copy
+  if (venue->data != MAP_FAILED) {
+    munmap(venue->data, size);
+  }
+  venue->data = NULL;
+
+  if (result != 0) {
+    pthread_mutex_unlock(&templates_mutex);
+    if (template->fd != -1) {
+      close(template->fd);
+    }
+    free(venue->row_reserved);
+    free(venue->free_runs);
+    buffer_free(&venue->reservation_seats);
+    buffer_free(&venue->reservation_index);
+    free(template);
     return 1;
   }
 
-  pthread_mutex_unlock(&event->mutex);
+  // The template's grid is shared by every event created from it, so it is counted once
+  tiering_track_shared(size);
+  template->id = template_id;
+  template->next = templates;
+  templates = template;
+  pthread_mutex_unlock(&templates_mutex);
   return 0;
 }
 
-int ems_list_events(int resp_fd) {
-  int return_value = 0;
+int ems_create_from_template(unsigned int template_id, size_t num_events, const unsigned int* event_ids) {
+  struct Template* template = find_template(template_id);
+  if (template == NULL) {
+    fprintf(stderr, "Template not found\n");
+    return 1;
+  }
+
+  return create_events(num_events, event_ids, template->event.rows, template->event.cols, template);
+}
+
+/// Work shared by the threads building the events of an import.
+struct ImportBuild {
+  const struct ImportedEvent* imported;
+  struct Event** events;
+  size_t num_events;
+  atomic_size_t next;  /// First event no thread has claimed yet.
+  atomic_int failed;   /// Whether an event could not be built, which stops every thread.
+};
+
+/// Fills in an imported event and makes its reservations, without taking any lock.
+/// @param event Event to fill in, whose grid arrays are allocated and zeroed.
+/// @param imported Description of the event.
+/// @return 0 if the event was built successfully, 1 otherwise.
+static int build_imported_event(struct Event* event, const struct ImportedEvent* imported) {
+  if (prepare_event(event, imported->id, imported->rows, imported->cols) != 0) {
+    fprintf(stderr, "Error initializing the mutex of event %u\n", imported->id);
+    return 1;
+  }
 
+  size_t num_seats = 0;
+  for (size_t r = 0; r < imported->num_reservations; r++) {
+    num_seats += imported->reservation_sizes[r];
+  }
+
+  // The whole index is allocated up front, the reservations are then appended within it
+  if (imported->num_reservations > 0) {
+    if (buffer_extend(&event->reservation_seats, sizeof(unsigned int) * num_seats) == NULL ||
+        buffer_extend(&event->reservation_index, sizeof(struct ReservationSeats) * imported->num_reservations) ==
+            NULL) {
+      fprintf(stderr, "Error allocating memory for the reservation index\n");
+      return 1;
+    }
+    event->reservation_seats.size = 0;
+    event->reservation_index.size = 0;
+  }
+
+  const size_t* seat = imported->seats;
+  for (size_t r = 0; r < imported->num_reservations; r++) {
+    unsigned int reservation_id = (unsigned int)r + 1;
+    for (size_t i = 0; i < imported->reservation_sizes[r]; i++, seat += 2) {
+      if (seat[0] <= 0 || seat[0] > event->rows || seat[1] <= 0 || seat[1] > event->cols) {
+        fprintf(stderr, "Seat out of bounds in reservation %u of event %u\n", reservation_id, event->id);
+        return 1;
+      }
+
+      size_t index = seat_index(event, seat[0], seat[1]);
+      if (event->data[index] != 0) {
+        fprintf(stderr, "Seat taken twice in reservation %u of event %u\n", reservation_id, event->id);
+        return 1;
+      }
+      event->data[index] = reservation_id;
+      event->row_reserved[seat[0] - 1]++;
+      index_seat(event, index);
+    }
+    index_reservation(event, imported->reservation_sizes[r]);
+  }
+
+  event->reservations = (unsigned int)imported->num_reservations;
+  event->reserved_seats = num_seats;
+  event->version += event->reservations;
+  event->changes_base = event->version;
+  for (size_t row = 1; row <= event->rows; row++) {
+    if (event->row_reserved[row - 1] > 0) {
+      scan_free_run(event, row);
+    }
+  }
+  return 0;
+}
+
+/// Builds imported events until none are left, claiming them in batches.
+/// @param arg The ImportBuild shared by the threads.
+/// @return NULL.
+static void* build_imported_events(void* arg) {
+  struct ImportBuild* build = arg;
+  while (!atomic_load(&build->failed)) {
+    size_t first = atomic_fetch_add(&build->next, IMPORT_BATCH_SIZE);
+    if (first >= build->num_events) {
+      break;
+    }
+
+    size_t last = first + IMPORT_BATCH_SIZE < build->num_events ? first + IMPORT_BATCH_SIZE : build->num_events;
+    for (size_t i = first; i < last; i++) {
+      if (build_imported_event(build->events[i], &build->imported[i]) != 0) {
+        atomic_store(&build->failed, 1);
+        return NULL;
+      }
+    }
+  }
+  return NULL;
+}
+
+/// Compares an event id with the id of an imported event, for bsearch.
+static int compare_imported_id(const void* key, const void* element) {
+  unsigned int id = *(const unsigned int*)key;
+  unsigned int imported_id = ((const struct ImportedEvent*)element)->id;
+  return (id > imported_id) - (id < imported_id);
+}
+
+int ems_import(size_t num_events, const struct ImportedEvent* imported, size_t num_threads) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
-    return_value = 1;
-    if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-      perror("Failed to write the return value to the response pipe.\n");
-      pthread_rwlock_unlock(&event_list->rwl);
+    return 1;
+  }
+
+  // The first event owns the row arenas, so there must be one
+  if (num_events == 0) {
+    return 0;
+  }
+
+  size_t grid_total = 0;
+  size_t rows_total = 0;
+  for (size_t i = 0; i < num_events; i++) {
+    if (i > 0 && imported[i].id <= imported[i - 1].id) {
+      fprintf(stderr, "Imported events must be sorted by id, without repeats\n");
       return 1;
     }
-    return 1;
+    // Every grid goes in one arena, so the total is checked as well as each event
+    if (check_dimensions(1, imported[i].rows, imported[i].cols) != 0 ||
+        imported[i].rows * imported[i].cols > SIZE_MAX / sizeof(unsigned int) - grid_total ||
+        imported[i].rows > SIZE_MAX / sizeof(struct FreeRun) - rows_total) {
+      fprintf(stderr, "Imported events are too large\n");
+      return 1;
+    }
+    grid_total += imported[i].rows * imported[i].cols;
+    rows_total += imported[i].rows;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+  // Every array comes out of arenas allocated at once, the pages are then touched by the threads building the events
+  struct GridArena* arena = malloc(sizeof(struct GridArena));
+  if (arena != NULL) {
+    arena->size = sizeof(unsigned int) * grid_total;
+    arena->data = calloc(grid_total > 0 ? grid_total : 1, sizeof(unsigned int));
+    arena->users = num_events;
+  }
+  size_t* row_reserved = calloc(rows_total > 0 ? rows_total : 1, sizeof(size_t));
+  struct FreeRun* free_runs = malloc(sizeof(struct FreeRun) * (rows_total > 0 ? rows_total : 1));
+  struct Event** events = calloc(num_events, sizeof(struct Event*));
+  int result = arena == NULL || arena->data == NULL || row_reserved == NULL || free_runs == NULL || events == NULL;
+
+  size_t grid_offset = 0;
+  size_t row_offset = 0;
+  for (size_t i = 0; result == 0 && i < num_events; i++) {
+    result = (events[i] = calloc(1, sizeof(struct Event))) == NULL;
+    if (result == 0) {
+      events[i]->data = arena->data + grid_offset;
+      events[i]->arena = arena;
+      events[i]->row_reserved = row_reserved + row_offset;
+      events[i]->free_runs = free_runs + row_offset;
+      events[i]->shares_grid = i > 0;
+      grid_offset += imported[i].rows * imported[i].cols;
+      row_offset += imported[i].rows;
+    }
+  }
+
+  if (result != 0) {
+    fprintf(stderr, "Error allocating memory for events\n");
+  } else {
+    // The calling thread builds too, so the import still completes if no thread can be started
+    struct ImportBuild build = {imported, events, num_events, 0, 0};
+    pthread_t* threads = malloc(sizeof(pthread_t) * (num_threads > 1 ? num_threads - 1 : 1));
+    size_t started = 0;
+    while (threads != NULL && started + 1 < num_threads &&
+           pthread_create(&threads[started], NULL, &build_imported_events, &build) == 0) {
+      started++;
+    }
+    build_imported_events(&build);
+    for (size_t i = 0; i < started; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    result = atomic_load(&build.failed);
+  }
+
+  if (result == 0 && pthread_rwlock_wrlock(&event_list->rwl) != 0) {
     fprintf(stderr, "Error locking list rwl\n");
-    return_value = 1;
-    if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-      perror("Failed to write the return value to the response pipe.\n");
-      pthread_rwlock_unlock(&event_list->rwl);
-      return 1;
+    result = 1;
+  } else if (result == 0) {
+    struct timespec delay = {0, state_access_delay_us * 1000};
+    nanosleep(&delay, NULL);  // Should not be removed
+
+    for (struct ListNode* node = event_list->head; result == 0 && node != NULL;
+         node = node == event_list->tail ? NULL : node->next) {
+      if (bsearch(&node->event->id, imported, num_events, sizeof(struct ImportedEvent), compare_imported_id) != NULL) {
+        fprintf(stderr, "Event already exists\n");
+        result = 1;
+      }
+    }
+
+    size_t slot = atomic_load_explicit(&num_event_slots, memory_order_relaxed);
+    result = result || grow_event_slots(slot, num_events) || append_all_to_list(event_list, events, num_events);
+    if (result == 0) {
+      // The slots are filled before they are counted, so readers without the lock never see them empty
+      tiering_track_shared(arena->size);
+      for (size_t i = 0; i < num_events; i++) {
+        place_event(events[i], slot + i);
+        publish_event(events[i]);
+      }
+      atomic_store_explicit(&num_event_slots, slot + num_events, memory_order_release);
     }
+    pthread_rwlock_unlock(&event_list->rwl);
+  }
+
+  if (result != 0) {
+    free_created_events(events, num_events);
+    free_grid_arena(arena);
+    free(row_reserved);
+    free(free_runs);
     return 1;
   }
 
-  struct ListNode* to = event_list->tail;
-  struct ListNode* current = event_list->head;
+  free(events);
+  return 0;
+}
 
-  unsigned int* ids = (unsigned int*) malloc(sizeof(unsigned int));
-  size_t num_events = 0;
+int ems_open_event(unsigned int event_id, struct EventRef* opened) {
+  struct Event* event = find_event(event_id);
+  if (event == NULL) {
+    return 1;
+  }
+
+  make_event_ref(event, opened);
+  return 0;
+}
 
-  // NO EVENTS REGISTERED IN SERVER
-  if (current == NULL) {
-    if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-      perror("Failed to write the return value to the response pipe.\n");
-      pthread_rwlock_unlock(&event_list->rwl);
+int ems_reserve(const struct EventRef* event_ref, struct EventCache* cache, size_t num_seats, size_t* xs, size_t* ys) {
+  struct Event* event = find_event_ref(event_ref, cache);
+  if (event == NULL) {
+    return 1;
+  }
+
+  if (lock_event(event) != 0) {
+    return 1;
+  }
+  // Seats arrive without duplicates, so bounds and availability can be checked in a single pass
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Seat out of bounds\n");
+      pthread_mutex_unlock(&event->mutex);
       return 1;
     }
-    if (write(resp_fd, &num_events, sizeof(char)) == -1) {
-      perror("Failed to write the number of events on the response pipe.\n");
-      pthread_rwlock_unlock(&event_list->rwl);
+
+    if (event->data[seat_index(event, xs[i], ys[i])] != 0) {
+      fprintf(stderr, "Seat already reserved\n");
+      pthread_mutex_unlock(&event->mutex);
       return 1;
     }
-    pthread_rwlock_unlock(&event_list->rwl);
-    return 0;
   }
-  //
 
-  while (1) {
-    ids = (unsigned int*) realloc(ids, sizeof(unsigned int) * (num_events+1));
-    if (ids == NULL) {
-      return_value = 1;
-      if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-        perror("Failed to write the return value to the response pipe.\n");
-        pthread_rwlock_unlock(&event_list->rwl);
-        return 1;
+  if (reserve_index_room(event, num_seats) != 0) {
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+
+  unsigned int reservation_id = ++event->reservations;
+  event->version++;
+
+  for (size_t i = 0; i < num_seats; i++) {
+    size_t seat = seat_index(event, xs[i], ys[i]);
+    tiering_write(event, seat);
+    event->data[seat] = reservation_id;
+    event->row_reserved[xs[i] - 1]++;
+    index_seat(event, seat);
+    log_seat_change(event, seat, reservation_id);
+  }
+  index_reservation(event, num_seats);
+  event->reserved_seats += num_seats;
+  for (size_t i = 0; i < num_seats; i++) {
+    take_free_run(event, xs[i], ys[i], ys[i]);
+  }
+  notify_event_changed(event, num_seats);
+
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
+
+/// Sets every seat of a list of ranges to the given value.
+/// @note The event mutex must be held and the ranges must be within bounds.
+/// @param event Event to modify.
+/// @param num_ranges Number of ranges to modify.
+/// @param ranges Array of ranges to modify.
+/// @param expected Only seats holding this value are modified.
+/// @param value Value to store in the seats.
+/// @return Number of ranges fully modified, num_ranges unless a seat did not hold the expected value.
+static size_t fill_ranges(struct Event* event, size_t num_ranges, const struct SeatRange* ranges, unsigned int expected,
+                          unsigned int value) {
+  for (size_t i = 0; i < num_ranges; i++) {
+    for (size_t row = ranges[i].x1; row <= ranges[i].x2; row++) {
+      size_t first = seat_index(event, row, 1);
+      unsigned int* seats = &event->data[first];
+      for (size_t col = ranges[i].y1 - 1; col < ranges[i].y2; col++) {
+        if (seats[col] != expected) {
+          return i;
+        }
+        tiering_write(event, first + col);
+        seats[col] = value;
       }
-      perror("Failed to alloc memory for the ids array.\n");
-      pthread_rwlock_unlock(&event_list->rwl);
+    }
+  }
+
+  return num_ranges;
+}
+
+int ems_reserve_ranges(const struct EventRef* event_ref, struct EventCache* cache, size_t num_ranges,
+                       const struct SeatRange* ranges) {
+  struct EventReservation part = {*event_ref, num_ranges, ranges, NULL, 0};
+  return ems_reserve_multi(1, &part, cache);
+}
+
+/// Counts the seats of a list of ranges, checking they are within the bounds of an event.
+/// @param event Event the ranges belong to.
+/// @param num_ranges Number of ranges.
+/// @param ranges Array of ranges.
+/// @param num_seats Pointer to the variable to store the number of seats in.
+/// @return 0 if every range is within bounds, 1 otherwise.
+static int count_seats(const struct Event* event, size_t num_ranges, const struct SeatRange* ranges,
+                       size_t* num_seats) {
+  *num_seats = 0;
+  for (size_t i = 0; i < num_ranges; i++) {
+    if (ranges[i].x1 == 0 || ranges[i].y1 == 0 || ranges[i].x1 > ranges[i].x2 || ranges[i].y1 > ranges[i].y2 ||
+        ranges[i].x2 > event->rows || ranges[i].y2 > event->cols) {
       return 1;
     }
-    ids[num_events] = (current->event)->id;
-    num_events++;
+    *num_seats += (ranges[i].x2 - ranges[i].x1 + 1) * (ranges[i].y2 - ranges[i].y1 + 1);
+  }
+  return 0;
+}
+
+/// Commits the seats claimed in an event by one or more parts of a reservation.
+/// @note The event mutex must be held, and the seats already hold the new reservation id.
+/// @param event Event the parts belong to.
+/// @param num_parts Number of parts.
+/// @param parts Array of parts, all for the same event.
+static void commit_parts(struct Event* event, size_t num_parts, const struct EventReservation* parts) {
+  unsigned int reservation_id = ++event->reservations;
+  event->version++;
+
+  size_t num_seats = 0;
+  for (size_t i = 0; i < num_parts; i++) {
+    num_seats += parts[i].num_seats;
+  }
+
+  // These changes alone would wrap the log, so older clients get the full grid instead
+  int logged = num_seats < EVENT_CHANGE_LOG_SIZE;
+  if (!logged) {
+    event->changes_base = event->version;
+  }
+
+  for (size_t i = 0; i < num_parts; i++) {
+    const struct SeatRange* ranges = parts[i].ranges;
+    for (size_t j = 0; j < parts[i].num_ranges; j++) {
+      for (size_t row = ranges[j].x1; row <= ranges[j].x2; row++) {
+        event->row_reserved[row - 1] += ranges[j].y2 - ranges[j].y1 + 1;
+        take_free_run(event, row, ranges[j].y1, ranges[j].y2);
+        for (size_t col = ranges[j].y1; col <= ranges[j].y2; col++) {
+          size_t seat = seat_index(event, row, col);
+          index_seat(event, seat);
+          if (logged) {
+            log_seat_change(event, seat, reservation_id);
+          }
+        }
+      }
+    }
+  }
+  index_reservation(event, num_seats);
+  event->reserved_seats += num_seats;
+  notify_event_changed(event, num_seats);
+}
 
-    if (current == to) {
+int ems_reserve_multi(size_t num_parts, struct EventReservation* parts, struct EventCache* cache) {
+  // Every event is found before any lock is taken, lookups may take a while
+  for (size_t i = 0; i < num_parts; i++) {
+    parts[i].target = find_event_ref(&parts[i].event, cache);
+    if (parts[i].target == NULL) {
+      return 1;
+    }
+  }
+
+  // Locks are taken in slot order, so bundles sharing events can't deadlock, and parts of one event end up together
+  for (size_t i = 1; i < num_parts; i++) {
+    struct EventReservation part = parts[i];
+    size_t j = i;
+    for (; j > 0 && parts[j - 1].target->slot > part.target->slot; j--) {
+      parts[j] = parts[j - 1];
+    }
+    parts[j] = part;
+  }
+
+  size_t locked = 0;
+  for (; locked < num_parts; locked++) {
+    if ((locked == 0 || parts[locked].target != parts[locked - 1].target) &&
+        lock_event(parts[locked].target) != 0) {
       break;
     }
-    current = current->next;
   }
 
-  // Success
-  if (write(resp_fd, &return_value, sizeof(int)) == -1) {
-    perror("Failed to write the return value to the response pipe.\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+  int result = locked != num_parts;
+  for (size_t i = 0; result == 0 && i < num_parts; i++) {
+    if (count_seats(parts[i].target, parts[i].num_ranges, parts[i].ranges, &parts[i].num_seats) != 0) {
+      fprintf(stderr, "Seat out of bounds\n");
+      result = 1;
+    }
+  }
+
+  // Every event gets room for its whole reservation before any seat is claimed
+  for (size_t i = 0, group_seats = 0; result == 0 && i < num_parts; i++) {
+    group_seats += parts[i].num_seats;
+    if (i + 1 == num_parts || parts[i + 1].target != parts[i].target) {
+      result = reserve_index_room(parts[i].target, group_seats);
+      group_seats = 0;
+    }
+  }
+
+  // Claim the seats range by range. A taken seat, or one claimed by an earlier overlapping range of the same
+  // event, holds a non-zero id, so a single pass finds every conflict. The claims are undone in the order they
+  // were made, so each undo stops right where its claim stopped.
+  for (size_t i = 0; result == 0 && i < num_parts; i++) {
+    struct EventReservation* part = &parts[i];
+    unsigned int reservation_id = part->target->reservations + 1;
+    size_t filled = fill_ranges(part->target, part->num_ranges, part->ranges, 0, reservation_id);
+    if (filled != part->num_ranges) {
+      for (size_t j = 0; j < i; j++) {
+        fill_ranges(parts[j].target, parts[j].num_ranges, parts[j].ranges, parts[j].target->reservations + 1, 0);
+      }
+      fill_ranges(part->target, filled + 1, part->ranges, reservation_id, 0);
+      fprintf(stderr, "Seat already reserved\n");
+      result = 1;
+    }
+  }
+
+  // Every event gets a single reservation, however many parts it had
+  for (size_t i = 0; i < locked;) {
+    size_t group = 1;
+    while (i + group < locked && parts[i + group].target == parts[i].target) {
+      group++;
+    }
+
+    if (result == 0) {
+      commit_parts(parts[i].target, group, &parts[i]);
+    }
+    pthread_mutex_unlock(&parts[i].target->mutex);
+    i += group;
+  }
+  return result;
+}
+
+int ems_reserve_best(const struct EventRef* event_ref, struct EventCache* cache, size_t num_seats, size_t near_row,
+                     struct SeatRange* reserved) {
+  struct Event* event = find_event_ref(event_ref, cache);
+  if (event == NULL) {
     return 1;
   }
 
-  if (write(resp_fd, &num_events, sizeof(size_t)) == -1) {
-    perror("Failed to write the number of events to the response pipe.\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+  if (lock_event(event) != 0) {
     return 1;
   }
 
-  if (write(resp_fd, ids, sizeof(unsigned int) * num_events) == -1) {
-    perror("Failed to write the id list to the response pipe.\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+  // Rows are tried by distance to the one asked for, the front one first on a tie
+  size_t target = near_row < 1 ? 1 : near_row > event->rows ? event->rows : near_row;
+  size_t row = 0;
+  for (size_t distance = 0; num_seats > 0 && row == 0 && distance < event->rows; distance++) {
+    if (distance < target && event->free_runs[target - distance - 1].length >= num_seats) {
+      row = target - distance;
+    } else if (target + distance <= event->rows && event->free_runs[target + distance - 1].length >= num_seats) {
+      row = target + distance;
+    }
+  }
+
+  if (row == 0) {
+    fprintf(stderr, "No row with enough adjacent free seats\n");
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+
+  if (reserve_index_room(event, num_seats) != 0) {
+    pthread_mutex_unlock(&event->mutex);
     return 1;
   }
 
+  size_t start = event->free_runs[row - 1].start;
+  struct SeatRange range = {row, start, row, start + num_seats - 1};
+  struct EventReservation part = {*event_ref, 1, &range, event, num_seats};
+  fill_ranges(event, 1, &range, 0, event->reservations + 1);
+  commit_parts(event, 1, &part);
+
+  pthread_mutex_unlock(&event->mutex);
+  *reserved = range;
+  return 0;
+}
+
+int ems_cancel(const struct EventRef* event_ref, struct EventCache* cache, unsigned int reservation_id) {
+  struct Event* event = find_event_ref(event_ref, cache);
+  if (event == NULL) {
+    return 1;
+  }
+
+  if (lock_event(event) != 0) {
+    return 1;
+  }
+
+  struct ReservationSeats* entry = find_reservation(event, reservation_id);
+  if (entry == NULL) {
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+
+  // Freed seats are logged like any other change, so deltas and subscribers see them go back to 0
+  const unsigned int* seats = (const unsigned int*)event->reservation_seats.data + entry->first;
+  int logged = entry->count < EVENT_CHANGE_LOG_SIZE;
+  event->version++;
+  if (!logged) {
+    event->changes_base = event->version;
+  }
+
+  for (size_t i = 0; i < entry->count; i++) {
+    tiering_write(event, seats[i]);
+    event->data[seats[i]] = 0;
+    event->row_reserved[seats[i] / event->cols]--;
+    if (logged) {
+      log_seat_change(event, seats[i], 0);
+    }
+  }
+
+  // Seats of a row are indexed next to each other, so each row is rescanned about once
+  size_t scanned_row = 0;
+  for (size_t i = 0; i < entry->count; i++) {
+    size_t row = seats[i] / event->cols + 1;
+    if (row != scanned_row) {
+      scan_free_run(event, row);
+      scanned_row = row;
+    }
+  }
+
+  // The seats stay in the arena, the id is never handed out again
+  size_t num_seats = entry->count;
+  event->reserved_seats -= num_seats;
+  entry->count = 0;
+  notify_event_changed(event, num_seats);
+
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
+
+int ems_get_reservation(struct Buffer* resp, const struct EventRef* event_ref, struct EventCache* cache,
+                        unsigned int reservation_id) {
+  struct Event* event = find_event_ref(event_ref, cache);
+  if (event == NULL) {
+    return write_failure(resp);
+  }
+
+  if (pthread_mutex_lock(&event->mutex) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return write_failure(resp);
+  }
+
+  const struct ReservationSeats* entry = find_reservation(event, reservation_id);
+  if (entry == NULL) {
+    pthread_mutex_unlock(&event->mutex);
+    return write_failure(resp);
+  }
+
+  size_t num_seats = entry->count;
+  size_t* xs = malloc(sizeof(size_t) * num_seats);
+  size_t* ys = malloc(sizeof(size_t) * num_seats);
+  int return_value = 0;
+  unsigned char* encoded = NULL;
+  if (xs == NULL || ys == NULL || buffer_append(resp, &return_value, sizeof(int)) != 0 ||
+      buffer_append(resp, &num_seats, sizeof(size_t)) != 0 ||
+      (encoded = buffer_extend(resp, sizeof(size_t) + VARINT_MAX_SIZE * num_seats)) == NULL) {
+    pthread_mutex_unlock(&event->mutex);
+    free(xs);
+    free(ys);
+    fprintf(stderr, "Failed to write the reservation to the response.\n");
+    return write_failure(resp);
+  }
+
+  const unsigned int* seats = (const unsigned int*)event->reservation_seats.data + entry->first;
+  for (size_t i = 0; i < num_seats; i++) {
+    xs[i] = seats[i] / event->cols + 1;
+    ys[i] = seats[i] % event->cols + 1;
+  }
+  pthread_mutex_unlock(&event->mutex);
+
+  // Same encoding as a RESERVE, the unused room is trimmed off
+  size_t encoded_size = seats_encode(num_seats, xs, ys, encoded + sizeof(size_t));
+  free(xs);
+  free(ys);
+  if (encoded_size == SIZE_MAX) {
+    fprintf(stderr, "Failed to encode the seats of the reservation.\n");
+    return write_failure(resp);
+  }
+
+  memcpy(encoded, &encoded_size, sizeof(size_t));
+  resp->size = resp->size - VARINT_MAX_SIZE * num_seats + encoded_size;
+  return 0;
+}
+
+int ems_show_many(struct Buffer* resp, size_t num_events, const unsigned int* event_ids, char features) {
+  struct Event** events = malloc(sizeof(struct Event*) * (num_events > 0 ? num_events : 1));
+  if (events == NULL || find_events(num_events, event_ids, events) != 0) {
+    free(events);
+    return write_failure(resp);
+  }
+
+  int return_value = 0;
+  int result = buffer_append(resp, &return_value, sizeof(int)) != 0 ||
+               buffer_append(resp, &num_events, sizeof(size_t)) != 0;
+
+  // A missing event only fails its own entry, the others are still shown
+  for (size_t i = 0; result == 0 && i < num_events; i++) {
+    struct Event* event = events[i];
+    return_value = event == NULL;
+    if (event == NULL) {
+      fprintf(stderr, "Event not found\n");
+      result = buffer_append(resp, &return_value, sizeof(int));
+      continue;
+    }
+
+    if (lock_event(event) != 0) {
+      result = 1;
+      break;
+    }
+    result = buffer_append(resp, &return_value, sizeof(int)) != 0 ||
+             buffer_append(resp, &event->rows, sizeof(size_t)) != 0 ||
+             buffer_append(resp, &event->cols, sizeof(size_t)) != 0 ||
+             write_seats(resp, event->data, event->rows * event->cols, features) != 0;
+    pthread_mutex_unlock(&event->mutex);
+  }
+
+  free(events);
+  if (result != 0) {
+    fprintf(stderr, "Failed to write the seats to the response.\n");
+    return write_failure(resp);
+  }
+  return 0;
+}
+
+int ems_show(struct Buffer* resp, const struct EventRef* event_ref, struct EventCache* cache, char features) {
+  struct Event* event = find_event_ref(event_ref, cache);
+  if (event == NULL) {
+    return write_failure(resp);
+  }
+
+  if (lock_event(event) != 0) {
+    return write_failure(resp);
+  }
+
+  int return_value = 0;
+  if (buffer_append(resp, &return_value, sizeof(int)) != 0 ||
+      buffer_append(resp, &event->rows, sizeof(size_t)) != 0 ||
+      buffer_append(resp, &event->cols, sizeof(size_t)) != 0 ||
+      write_seats(resp, event->data, event->rows * event->cols, features) != 0) {
+    pthread_mutex_unlock(&event->mutex);
+    fprintf(stderr, "Failed to write the seats to the response.\n");
+    return write_failure(resp);
+  }
+
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
+
+int ems_stats(struct Buffer* resp, const struct EventRef* event_ref, struct EventCache* cache, char with_rows) {
+  struct Event* event = find_event_ref(event_ref, cache);
+  if (event == NULL) {
+    return write_failure(resp);
+  }
+
+  if (pthread_mutex_lock(&event->mutex) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return write_failure(resp);
+  }
+
+  // The counters are kept by every reservation, so this never touches the seats
+  int return_value = 0;
+  size_t free_seats = event->rows * event->cols - event->reserved_seats;
+  size_t cache_hits = cache != NULL ? cache->hits : 0;
+  size_t cache_misses = cache != NULL ? cache->misses : 0;
+  if (buffer_append(resp, &return_value, sizeof(int)) != 0 ||
+      buffer_append(resp, &event->rows, sizeof(size_t)) != 0 ||
+      buffer_append(resp, &event->cols, sizeof(size_t)) != 0 ||
+      buffer_append(resp, &free_seats, sizeof(size_t)) != 0 ||
+      buffer_append(resp, &event->reservations, sizeof(unsigned int)) != 0 ||
+      buffer_append(resp, &cache_hits, sizeof(size_t)) != 0 ||
+      buffer_append(resp, &cache_misses, sizeof(size_t)) != 0 ||
+      (with_rows && buffer_append(resp, event->row_reserved, sizeof(size_t) * event->rows) != 0)) {
+    pthread_mutex_unlock(&event->mutex);
+    fprintf(stderr, "Failed to write the stats to the response.\n");
+    return write_failure(resp);
+  }
+
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
+
+int ems_show_since(struct Buffer* resp, const struct EventRef* event_ref, struct EventCache* cache,
+                   unsigned int since_version, char features) {
+  struct Event* event = find_event_ref(event_ref, cache);
+  if (event == NULL) {
+    return write_failure(resp);
+  }
+
+  if (lock_event(event) != 0) {
+    return write_failure(resp);
+  }
+
+  // A delta can only be served if every change made after the client version is still logged
+  char kind = EMS_SHOW_DELTA;
+  if (since_version == 0 || since_version > event->version || since_version < event->changes_base) {
+    kind = EMS_SHOW_FULL;
+  }
+
+  int return_value = 0;
+  int result = buffer_append(resp, &return_value, sizeof(int)) ||
+               buffer_append(resp, &event->version, sizeof(unsigned int)) ||
+               buffer_append(resp, &event->rows, sizeof(size_t)) || buffer_append(resp, &event->cols, sizeof(size_t)) ||
+               buffer_append(resp, &kind, sizeof(char));
+
+  if (result == 0 && kind == EMS_SHOW_FULL) {
+    result = write_seats(resp, event->data, event->rows * event->cols, features);
+  } else if (result == 0) {
+    // (seat, reservation id) pairs, oldest first, preceded by how many there are
+    size_t count_offset = resp->size;
+    size_t num_changes = 0;
+    result = buffer_extend(resp, sizeof(size_t)) == NULL;
+
+    size_t logged = event->num_changes < EVENT_CHANGE_LOG_SIZE ? event->num_changes : EVENT_CHANGE_LOG_SIZE;
+    for (size_t i = event->num_changes - logged; result == 0 && i < event->num_changes; i++) {
+      struct SeatChange* change = &event->changes[i % EVENT_CHANGE_LOG_SIZE];
+      if (change->version > since_version) {
+        result = buffer_append(resp, &change->seat, sizeof(unsigned int)) ||
+                 buffer_append(resp, &change->reservation_id, sizeof(unsigned int));
+        num_changes++;
+      }
+    }
+
+    if (result == 0) {
+      memcpy(resp->data + count_offset, &num_changes, sizeof(size_t));
+    }
+  }
+  pthread_mutex_unlock(&event->mutex);
+
+  if (result != 0) {
+    fprintf(stderr, "Failed to write the seats to the response.\n");
+    return write_failure(resp);
+  }
+  return 0;
+}
+
+size_t ems_count_events(void) { return atomic_load_explicit(&num_event_slots, memory_order_acquire); }
+
+int ems_list_events(struct Buffer* resp, size_t first, size_t num_events) {
+  // Whole chunks are copied at once, the ids of a chunk are contiguous
+  while (num_events > 0) {
+    size_t offset = first % EVENT_SLOT_CHUNK_SIZE;
+    size_t count = EVENT_SLOT_CHUNK_SIZE - offset < num_events ? EVENT_SLOT_CHUNK_SIZE - offset : num_events;
+    const unsigned int* ids = event_id_chunks[first / EVENT_SLOT_CHUNK_SIZE] + offset;
+    if (buffer_append(resp, ids, sizeof(unsigned int) * count) != 0) {
+      fprintf(stderr, "Failed to write the id list to the response.\n");
+      return 1;
+    }
+    first += count;
+    num_events -= count;
+  }
+  return 0;
+}
+
+int ems_list_range(struct Buffer* resp, unsigned int first_id, unsigned int last_id, size_t min_free_seats,
+                   size_t limit) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return write_failure(resp);
+  }
+
+  if (limit == 0 || limit > EMS_LIST_PAGE_SIZE) {
+    limit = EMS_LIST_PAGE_SIZE;
+  }
+
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return write_failure(resp);
+  }
+
+  // The cursor and the number of ids are only known after the walk, so their slots are filled in at the end
+  int return_value = 0;
+  char more = 0;
+  unsigned int next_id = 0;
+  size_t num_events = 0;
+  int result = buffer_append(resp, &return_value, sizeof(int)) || buffer_append(resp, &more, sizeof(char)) ||
+               buffer_append(resp, &next_id, sizeof(unsigned int)) || buffer_extend(resp, sizeof(size_t)) == NULL;
+  size_t header_offset = resp->size - sizeof(size_t) - sizeof(unsigned int) - sizeof(char);
+
+  struct IndexNode* node = first_id <= last_id ? index_lower_bound(event_list, first_id) : NULL;
+  for (; result == 0 && node != NULL && node->event->id <= last_id && num_events < limit; node = node->next[0]) {
+    struct Event* event = node->event;
+    if (min_free_seats > 0) {
+      if (pthread_mutex_lock(&event->mutex) != 0) {
+        fprintf(stderr, "Error locking mutex\n");
+        result = 1;
+        break;
+      }
+      size_t free_seats = event->rows * event->cols - event->reserved_seats;
+      pthread_mutex_unlock(&event->mutex);
+      if (free_seats < min_free_seats) {
+        continue;
+      }
+    }
+
+    result = buffer_append(resp, &event->id, sizeof(unsigned int));
+    num_events++;
+  }
+
+  // Events left in the range may not pass the filter, the next page then comes back empty
+  if (node != NULL && node->event->id <= last_id) {
+    more = 1;
+    next_id = node->event->id;
+  }
+
   pthread_rwlock_unlock(&event_list->rwl);
+
+  if (result != 0) {
+    fprintf(stderr, "Failed to write the id range to the response.\n");
+    return write_failure(resp);
+  }
+
+  memcpy(resp->data + header_offset, &more, sizeof(char));
+  memcpy(resp->data + header_offset + sizeof(char), &next_id, sizeof(unsigned int));
+  memcpy(resp->data + header_offset + sizeof(char) + sizeof(unsigned int), &num_events, sizeof(size_t));
+  return 0;
+}
+
+int ems_show_text(struct Buffer* out, const struct EventRef* event_ref, struct EventCache* cache) {
+  struct Event* event = find_event_ref(event_ref, cache);
+  if (event == NULL) {
+    return 1;
+  }
+
+  if (lock_event(event) != 0) {
+    return 1;
+  }
+
+  size_t start = out->size;
+  int result = 0;
+  const unsigned int* seat = event->data;
+  for (size_t i = 1; result == 0 && i <= event->rows; i++) {
+    for (size_t j = 1; result == 0 && j <= event->cols; j++) {
+      result = buffer_append_uint(out, *seat++) || buffer_append(out, j < event->cols ? " " : "\n", 1);
+    }
+  }
+
+  pthread_mutex_unlock(&event->mutex);
+
+  if (result != 0) {
+    fprintf(stderr, "Failed to render the event.\n");
+    out->size = start;
+  }
+  return result;
+}
+
+void* ems_tiering_worker() {
+  while (1) {
+    sleep(tiering_period());
+
+    // Events in use are skipped rather than waited for, they are not cold anyway
+    time_t now = tiering_now();
+    size_t num_events = ems_count_events();
+    size_t num_spilled = 0;
+    for (size_t slot = 0; slot < num_events; slot++) {
+      struct Event* event = event_slot_chunks[slot / EVENT_SLOT_CHUNK_SIZE][slot % EVENT_SLOT_CHUNK_SIZE];
+      if (pthread_mutex_trylock(&event->mutex) == 0) {
+        num_spilled += (size_t)tiering_spill_if_cold(event, now);
+        pthread_mutex_unlock(&event->mutex);
+      }
+    }
+
+    if (num_spilled > 0) {
+      size_t resident, spilled;
+      tiering_usage(&resident, &spilled);
+      fprintf(stderr, "Spilled %zu cold events, %zu bytes of seats resident and %zu spilled.\n", num_spilled, resident,
+              spilled);
+    }
+  }
+  return NULL;
+}
+
+int ems_list_events_text(struct Buffer* out) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  size_t start = out->size;
+  size_t num_events = ems_count_events();
+  int result = 0;
+  for (size_t slot = 0; result == 0 && slot < num_events; slot++) {
+    result = buffer_append(out, "Event: ", 7) ||
+             buffer_append_uint(out, event_id_chunks[slot / EVENT_SLOT_CHUNK_SIZE][slot % EVENT_SLOT_CHUNK_SIZE]) ||
+             buffer_append(out, "\n", 1);
+  }
+
+  if (result != 0) {
+    fprintf(stderr, "Failed to render the id list.\n");
+    out->size = start;
+  }
+  return result;
+}
+
+int ems_subscribe(struct Subscription* subscription) {
+  struct Event* event = find_event(subscription->event_id);
+  if (event == NULL) {
+    return 1;
+  }
+
+  if (pthread_mutex_lock(&event->mutex) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
+  }
+
+  subscription->event = event;
+  subscription->next_in_event = event->subscribers;
+  event->subscribers = subscription;
+
+  pthread_mutex_unlock(&event->mutex);
   return 0;
-}
\ No newline at end of file
+}
+
+void ems_unsubscribe(struct Subscription* subscription) {
+  struct Event* event = subscription->event;
+  pthread_mutex_lock(&event->mutex);
+
+  struct Subscription** prev = &event->subscribers;
+  while (*prev != NULL && *prev != subscription) {
+    prev = &(*prev)->next_in_event;
+  }
+  if (*prev != NULL) {
+    *prev = subscription->next_in_event;
+  }
+
+  pthread_mutex_unlock(&event->mutex);
+  subscription->event = NULL;
+}
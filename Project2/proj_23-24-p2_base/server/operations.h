@@ -3,6 +3,36 @@
 
 #include <stddef.h>
 
+#include "common/codec.h"
+#include "common/io.h"
+
+struct Event;
+struct Subscription;
+
+#define EVENT_SLOT_CHUNK_SIZE 1024  // Slots allocated at once in the table of events addressed by handles
+#define EVENT_SLOT_CHUNKS 1024      // Most chunks in the table, which caps the number of events
+#define IMPORT_BATCH_SIZE 64        // Events claimed at once by each thread building an import
+#define EVENT_CACHE_SIZE 8          // Events remembered per session
+
+/// Events a session used last, so the requests that address them by id skip the lookup.
+/// @note Only touched while serving the session, so it needs no lock.
+struct EventCache {
+  struct EventRef entries[EVENT_CACHE_SIZE];  /// Most recently used first, generation 0 if the entry is empty.
+  size_t hits;                                /// Requests that found their event in the cache.
+  size_t misses;                              /// Requests that had to look their event up.
+};
+
+/// Seats to reserve in one event, as part of a reservation spanning several events.
+struct EventReservation {
+  struct EventRef event;           /// Event to reserve the seats in.
+  size_t num_ranges;               /// Number of ranges of seats.
+  const struct SeatRange *ranges;  /// Array of ranges of seats.
+
+  // Filled in while reserving
+  struct Event *target;  /// Event found for the reference.
+  size_t num_seats;      /// Number of seats in the ranges.
+};
+
 /// Initializes the EMS state.
 /// @param delay_us Delay in microseconds.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
@@ -15,26 +45,206 @@ int ems_terminate();
 /// @param event_id Id of the event to be created.
 /// @param num_rows Number of rows of the event to be created.
 /// @param num_cols Number of columns of the event to be created.
+/// @param created Pointer to store a handle to the new event in, NULL if it is not needed.
 /// @return 0 if the event was created successfully, 1 otherwise.
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols, struct EventRef *created);
+
+/// Creates several events with the same dimensions at once.
+/// @note Either every event is created or none is. Duplicates are checked in a single pass over the state, the
+///       grids come out of shared arenas and the events are published under a single write lock.
+/// @param num_events Number of events to be created.
+/// @param event_ids Array of ids of the events to be created.
+/// @param num_rows Number of rows of each event.
+/// @param num_cols Number of columns of each event.
+/// @return 0 if the events were created successfully, 1 otherwise.
+int ems_create_many(size_t num_events, const unsigned int *event_ids, size_t num_rows, size_t num_cols);
+
+/// Creates a venue template, which events with its dimensions and pre-blocked seats can be created from.
+/// @note The pre-blocked seats become reservation 1 of every event created from the template.
+/// @param template_id Id of the template, templates and events have ids of their own.
+/// @param num_rows Number of rows of the venue.
+/// @param num_cols Number of columns of the venue.
+/// @param num_blocked Number of pre-blocked seats, 0 for none.
+/// @param xs Array of rows of the pre-blocked seats.
+/// @param ys Array of columns of the pre-blocked seats.
+/// @return 0 if the template was created successfully, 1 otherwise.
+int ems_create_template(unsigned int template_id, size_t num_rows, size_t num_cols, size_t num_blocked, size_t *xs,
+                        size_t *ys);
+
+/// Creates several events from a template at once, as ems_create_many does.
+/// @note The grid of each event maps the template's copy-on-write, so an event only gets private pages of seats
+///       once a reservation or cancellation writes to them.
+/// @param template_id Id of the template.
+/// @param num_events Number of events to be created.
+/// @param event_ids Array of ids of the events to be created.
+/// @return 0 if the events were created successfully, 1 otherwise.
+int ems_create_from_template(unsigned int template_id, size_t num_events, const unsigned int *event_ids);
+
+/// Event created by an import, with the reservations it starts with.
+struct ImportedEvent {
+  unsigned int id;
+  size_t rows;
+  size_t cols;
+  size_t num_reservations;          /// Reservations of the event, given ids from 1 in order.
+  const size_t *reservation_sizes;  /// Number of seats of each reservation.
+  const size_t *seats;              /// Row and column of every seat of every reservation, back to back.
+};
+
+/// Creates the events of an import with their reservations already made.
+/// @note Either every event is created or none is. The grids are built by several threads without any lock, then
+///       the events are published under a single write lock, as ems_create_many does.
+/// @param num_events Number of events to be created.
+/// @param imported Array of events to be created, sorted by id.
+/// @param num_threads Number of threads building the grids, the calling thread included.
+/// @return 0 if the events were created successfully, 1 otherwise.
+int ems_import(size_t num_events, const struct ImportedEvent *imported, size_t num_threads);
+
+/// Looks an event up and gives out a handle to it, so later requests can skip the lookup.
+/// @param event_id Id of the event to open.
+/// @param opened Pointer to store the handle in.
+/// @return 0 if the event was found, 1 otherwise.
+int ems_open_event(unsigned int event_id, struct EventRef *opened);
 
 /// Creates a new reservation for the given event.
-/// @param event_id Id of the event to create a reservation for.
+/// @param event Event to create a reservation for.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @note The seats must not contain duplicates.
 /// @param num_seats Number of seats to reserve.
 /// @param xs Array of rows of the seats to reserve.
 /// @param ys Array of columns of the seats to reserve.
 /// @return 0 if the reservation was created successfully, 1 otherwise.
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
+int ems_reserve(const struct EventRef *event, struct EventCache *cache, size_t num_seats, size_t *xs, size_t *ys);
+
+/// Creates a new reservation for the given event from ranges of seats.
+/// @note Either every seat in the ranges is reserved or none is, overlapping ranges are rejected.
+/// @param event Event to create a reservation for.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @param num_ranges Number of ranges to reserve.
+/// @param ranges Array of ranges of seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_ranges(const struct EventRef *event, struct EventCache *cache, size_t num_ranges,
+                       const struct SeatRange *ranges);
+
+/// Creates one reservation in each of several events, atomically.
+/// @note The events are locked in a global order and every seat is checked before any is committed, so either
+///       every part is reserved or none is. Parts of the same event share a single reservation.
+/// @param num_parts Number of parts.
+/// @param parts Array of parts, reordered by the call.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @return 0 if every reservation was created successfully, 1 otherwise.
+int ems_reserve_multi(size_t num_parts, struct EventReservation *parts, struct EventCache *cache);
 
 /// Prints the given event.
-/// @param out_fd File descriptor to print the event to.
-/// @param event_id Id of the event to print.
+/// @param resp Response to print the event to.
+/// @param event Event to print.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @param features Features negotiated by the session, selects the seats encoding.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+int ems_show(struct Buffer *resp, const struct EventRef *event, struct EventCache *cache, char features);
+
+/// Reserves adjacent seats in the row nearest to the one asked for, in a single step.
+/// @note The row is found from the longest free run kept for every row, without scanning the seats.
+/// @param event Event to create a reservation for.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @param num_seats Number of adjacent seats to reserve.
+/// @param near_row Row the seats should be closest to.
+/// @param reserved Pointer to the variable to store the reserved seats in.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_best(const struct EventRef *event, struct EventCache *cache, size_t num_seats, size_t near_row,
+                     struct SeatRange *reserved);
+
+/// Cancels a reservation, freeing its seats.
+/// @note Only the seats of the reservation are visited, found through the reservation index of the event.
+/// @param event Event the reservation is for.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @param reservation_id Id of the reservation to cancel.
+/// @return 0 if the reservation was cancelled successfully, 1 otherwise.
+int ems_cancel(const struct EventRef *event, struct EventCache *cache, unsigned int reservation_id);
+
+/// Sends the seats of a reservation.
+/// @param resp Response to write the seats to.
+/// @param event Event the reservation is for.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @param reservation_id Id of the reservation.
+/// @return 0 if the seats were written successfully, 1 otherwise.
+int ems_get_reservation(struct Buffer *resp, const struct EventRef *event, struct EventCache *cache,
+                        unsigned int reservation_id);
+
+/// Sends the occupancy of the given event, without its seats.
+/// @note The hits and misses of the session's event cache are sent too, 0 if it has none.
+/// @param resp Response to write the occupancy to.
+/// @param event Event to describe.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @param with_rows Whether the number of taken seats of every row is sent too.
+/// @return 0 if the occupancy was written successfully, 1 otherwise.
+int ems_stats(struct Buffer *resp, const struct EventRef *event, struct EventCache *cache, char with_rows);
+
+/// Prints several events in a single response.
+/// @note The events are looked up in a single pass over the state. Each one gets its own return value, so a
+///       missing event doesn't fail the others.
+/// @param resp Response to print the events to.
+/// @param num_events Number of events to print.
+/// @param event_ids Array of ids of the events.
+/// @param features Features negotiated by the session, selects the seats encoding.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+int ems_show_many(struct Buffer *resp, size_t num_events, const unsigned int *event_ids, char features);
+
+/// Sends the changes made to the given event since a version the client already has.
+/// @param resp Response to print the event to.
+/// @param event Event to print.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @param since_version Version of the grid the client has, 0 if it has none.
+/// @param features Features negotiated by the session, selects the seats encoding.
 /// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(int out_fd, unsigned int event_id);
+int ems_show_since(struct Buffer *resp, const struct EventRef *event, struct EventCache *cache,
+                   unsigned int since_version, char features);
 
-/// Prints all the events.
-/// @param out_fd File descriptor to print the events to.
+/// Gets the number of events created so far.
+/// @note Events are never removed, so the ids of the first ones can be listed without any lock.
+/// @return The number of events, in creation order.
+size_t ems_count_events(void);
+
+/// Appends the ids of some events, in creation order, which is also the order of the event list.
+/// @param resp Response to append the ids to.
+/// @param first Position of the first event to list.
+/// @param num_events Number of events to list, first + num_events must not exceed ems_count_events().
+/// @return 0 if the ids were appended successfully, 1 otherwise.
+int ems_list_events(struct Buffer *resp, size_t first, size_t num_events);
+
+/// Sends the ids of the events in an id range, in id order, through the index instead of the whole list.
+/// @note Takes O(log n) to reach the first event, then one step per event in the range until the limit is reached.
+/// @param resp Response to write the ids to, followed by the cursor of the next page.
+/// @param first_id Lowest id wanted, or the cursor of the previous page.
+/// @param last_id Highest id wanted.
+/// @param min_free_seats Events with fewer free seats are skipped, 0 to list every event.
+/// @param limit Most ids to send, up to EMS_LIST_PAGE_SIZE, 0 for that many.
+/// @return 0 if the ids were written successfully, 1 otherwise.
+int ems_list_range(struct Buffer *resp, unsigned int first_id, unsigned int last_id, size_t min_free_seats,
+                   size_t limit);
+
+/// Spills the grids of events left untouched for too long, forever.
+/// @note Must only run once tiering_init succeeded. Cold events are read back by the next operation on their seats.
+void *ems_tiering_worker();
+
+/// Prints the given event as text, in the format of the client's .out files.
+/// @param out Buffer to append the text to, left untouched on failure.
+/// @param event Event to print.
+/// @param cache Cache of the session making the request, NULL if it has none.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+int ems_show_text(struct Buffer *out, const struct EventRef *event, struct EventCache *cache);
+
+/// Prints all the events as text, in the format of the client's .out files.
+/// @param out Buffer to append the text to, left untouched on failure.
 /// @return 0 if the events were printed successfully, 1 otherwise.
-int ems_list_events(int resp_fd);
+int ems_list_events_text(struct Buffer *out);
+
+/// Attaches a subscription to its event, so every later reservation of the event is pushed to it.
+/// @param subscription Subscription to attach, with the id of the event set.
+/// @return 0 if the subscription was attached successfully, 1 otherwise.
+int ems_subscribe(struct Subscription *subscription);
+
+/// Detaches a subscription from its event, no reservation is pushed to it afterwards.
+/// @param subscription Subscription attached by ems_subscribe.
+void ems_unsubscribe(struct Subscription *subscription);
 
 #endif  // SERVER_OPERATIONS_H
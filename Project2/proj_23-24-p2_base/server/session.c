@@ -0,0 +1,195 @@
+#include "session.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "notify.h"
+
+// Sessions with queued requests that no worker is serving yet
+static struct Session* ready_head = NULL;
+static struct Session* ready_tail = NULL;
+static pthread_mutex_t ready_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready_cond = PTHREAD_COND_INITIALIZER;
+
+static request_handler handle_request = NULL;
+
+/// Appends a session to the ready queue.
+/// @note The ready mutex must be held.
+/// @param session Session to append.
+static void push_ready(struct Session* session) {
+  session->next_ready = NULL;
+  if (ready_tail == NULL) {
+    ready_head = session;
+  } else {
+    ready_tail->next_ready = session;
+  }
+  ready_tail = session;
+  pthread_cond_signal(&ready_cond);
+}
+
+int scheduler_init(request_handler handler) {
+  if (handler == NULL) {
+    return 1;
+  }
+
+  handle_request = handler;
+  return 0;
+}
+
+void* scheduler_worker() {
+  while (1) {
+    pthread_mutex_lock(&ready_mutex);
+    while (ready_head == NULL) {
+      pthread_cond_wait(&ready_cond, &ready_mutex);
+    }
+
+    struct Session* session = ready_head;
+    ready_head = session->next_ready;
+    if (ready_head == NULL) {
+      ready_tail = NULL;
+    }
+
+    struct Request* request = session->head;
+    session->head = request->next;
+    if (session->head == NULL) {
+      session->tail = NULL;
+    }
+    pthread_mutex_unlock(&ready_mutex);
+
+    handle_request(session, request);
+    free(request->payload);
+    free(request);
+
+    // Requests that arrived meanwhile go to the back of the queue, so busy sessions don't starve the others
+    pthread_mutex_lock(&ready_mutex);
+    if (session->head != NULL) {
+      push_ready(session);
+    } else {
+      session->scheduled = 0;
+    }
+
+    struct Connection* connection = session->connection;
+    if (--connection->pending == 0) {
+      pthread_cond_broadcast(&connection->idle);
+    }
+    pthread_mutex_unlock(&ready_mutex);
+  }
+}
+
+struct Connection* connection_create(int id, int req_fd, int resp_fd, char features) {
+  struct Connection* connection = malloc(sizeof(struct Connection));
+  if (connection == NULL) {
+    return NULL;
+  }
+
+  if (pthread_mutex_init(&connection->write_mutex, NULL) != 0) {
+    free(connection);
+    return NULL;
+  }
+  if (pthread_cond_init(&connection->idle, NULL) != 0) {
+    pthread_mutex_destroy(&connection->write_mutex);
+    free(connection);
+    return NULL;
+  }
+
+  connection->id = id;
+  connection->req_fd = req_fd;
+  connection->resp_fd = resp_fd;
+  connection->features = features;
+  connection->pending = 0;
+  connection->sessions = NULL;
+  return connection;
+}
+
+struct Session* connection_get_session(struct Connection* connection, int session_id) {
+  for (struct Session* session = connection->sessions; session != NULL; session = session->next) {
+    if (session->id == session_id) {
+      return session;
+    }
+  }
+
+  struct Session* session = calloc(1, sizeof(struct Session));
+  if (session == NULL) {
+    return NULL;
+  }
+
+  session->id = session_id;
+  session->connection = connection;
+  session->next = connection->sessions;
+  connection->sessions = session;
+  return session;
+}
+
+void connection_destroy(struct Connection* connection) {
+  pthread_mutex_lock(&ready_mutex);
+  while (connection->pending > 0) {
+    pthread_cond_wait(&connection->idle, &ready_mutex);
+  }
+  pthread_mutex_unlock(&ready_mutex);
+
+  // Pushes may still be on their way to the response pipe
+  for (struct Session* session = connection->sessions; session != NULL; session = session->next) {
+    notify_cancel_all(session);
+  }
+
+  close(connection->req_fd);
+  close(connection->resp_fd);
+
+  struct Session* session = connection->sessions;
+  while (session != NULL) {
+    struct Session* next = session->next;
+    session_release_buffers(session);
+    free(session);
+    session = next;
+  }
+
+  pthread_cond_destroy(&connection->idle);
+  pthread_mutex_destroy(&connection->write_mutex);
+  free(connection);
+}
+
+void session_enqueue(struct Session* session, struct Request* request) {
+  request->next = NULL;
+
+  pthread_mutex_lock(&ready_mutex);
+  if (session->tail == NULL) {
+    session->head = request;
+  } else {
+    session->tail->next = request;
+  }
+  session->tail = request;
+  session->connection->pending++;
+
+  if (!session->scheduled) {
+    session->scheduled = 1;
+    push_ready(session);
+  }
+  pthread_mutex_unlock(&ready_mutex);
+}
+
+int session_respond(struct Session* session, const struct Request* request, const void* payload, size_t size) {
+  return session_push(session, request->op, request->id, payload, size);
+}
+
+int session_push(struct Session* session, char op, unsigned int request_id, const void* payload, size_t size) {
+  struct Connection* connection = session->connection;
+
+  pthread_mutex_lock(&connection->write_mutex);
+  int result = write_frame(connection->resp_fd, op, session->id, request_id, payload, size);
+  pthread_mutex_unlock(&connection->write_mutex);
+
+  if (result != 0) {
+    fprintf(stderr, "Failed to write a response for session %d of connection %d.\n", session->id, connection->id);
+  }
+  return result;
+}
+
+void session_release_buffers(struct Session* session) {
+  free(session->seats.xs);
+  free(session->seats.ys);
+  free(session->seats.ranges);
+  session->seats = (struct SeatBuffer){0, NULL, NULL, 0, 0, 0, NULL};
+  buffer_free(&session->response);
+  buffer_free(&session->script);
+}
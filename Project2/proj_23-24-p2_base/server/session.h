@@ -0,0 +1,124 @@
+#ifndef SERVER_SESSION_H
+#define SERVER_SESSION_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "common/codec.h"
+#include "common/io.h"
+#include "operations.h"
+
+/// Request received from a client, waiting to be served.
+struct Request {
+  char op;               /// Op code of the request.
+  unsigned int id;       /// Id chosen by the client, echoed back in the response.
+  char* payload;         /// Payload of the request.
+  size_t size;           /// Size of the payload.
+  struct Request* next;  /// Next request of the same session.
+};
+
+/// Scratch space reused by every RESERVE of a session.
+struct SeatBuffer {
+  size_t seats_capacity;
+  size_t* xs;
+  size_t* ys;
+  size_t ranges_capacity;
+  size_t num_ranges;  /// Ranges received so far for the RESERVE_RANGES being streamed.
+  int discarding;     /// Whether the RESERVE_RANGES being streamed was already rejected.
+  struct SeatRange* ranges;
+};
+
+struct Connection;
+struct Subscription;
+
+/// Logical session multiplexed over a client connection.
+struct Session {
+  int id;  /// Id chosen by the client, unique within its connection.
+  struct Connection* connection;
+
+  struct SeatBuffer seats;  /// Reused by every RESERVE of the session.
+  struct Buffer response;   /// Reused by every response of the session.
+  struct Buffer script;     /// Script received so far for the RUN_JOBS being streamed.
+  int script_discarding;    /// Whether the RUN_JOBS being streamed was already rejected.
+
+  struct Subscription* subscriptions;  /// Events the session is notified of, until it quits.
+  struct EventCache events;            /// Events the session used last.
+
+  struct Request* head;  /// Requests waiting to be served, oldest first.
+  struct Request* tail;
+  int scheduled;                /// Whether the session is in the ready queue or being served.
+  struct Session* next_ready;   /// Next session in the ready queue.
+  struct Session* next;         /// Next session of the same connection.
+};
+
+/// Request and response pipes opened by a client process.
+struct Connection {
+  int id;         /// Id sent back to the client at setup.
+  int req_fd;     /// Request pipe, only read by the connection reader.
+  int resp_fd;    /// Response pipe, shared by every session of the connection.
+  char features;  /// Features negotiated at setup, shared by every session of the connection.
+
+  pthread_mutex_t write_mutex;  /// Serializes the frames written to the response pipe.
+  size_t pending;               /// Requests queued or being served, protected by the scheduler lock.
+  pthread_cond_t idle;          /// Signaled when no requests are pending.
+  struct Session* sessions;     /// Sessions seen so far, only touched by the connection reader.
+};
+
+/// Serves a request of a session, writing its response if it has one.
+typedef void (*request_handler)(struct Session* session, struct Request* request);
+
+/// Initializes the scheduler shared by every connection.
+/// @param handler Function called to serve each request.
+/// @return 0 if the scheduler was initialized successfully, 1 otherwise.
+int scheduler_init(request_handler handler);
+
+/// Serves requests from the ready sessions, forever.
+/// @note Each session is served by at most one worker at a time, so its requests run in order.
+void* scheduler_worker();
+
+/// Creates a connection for a pair of opened pipes.
+/// @param id Id of the connection.
+/// @param req_fd File descriptor of the request pipe.
+/// @param resp_fd File descriptor of the response pipe.
+/// @param features Features negotiated at setup.
+/// @return Newly created connection, NULL on failure.
+struct Connection* connection_create(int id, int req_fd, int resp_fd, char features);
+
+/// Gets a session of the connection, creating it the first time its id is seen.
+/// @note Must only be called by the connection reader.
+/// @param connection Connection the session belongs to.
+/// @param session_id Id of the session.
+/// @return Pointer to the session, NULL on failure.
+struct Session* connection_get_session(struct Connection* connection, int session_id);
+
+/// Waits for every pending request of the connection, then closes its pipes and frees it.
+/// @param connection Connection to destroy.
+void connection_destroy(struct Connection* connection);
+
+/// Queues a request to be served after the earlier requests of its session.
+/// @param session Session the request belongs to.
+/// @param request Request to queue, owned by the scheduler from now on.
+void session_enqueue(struct Session* session, struct Request* request);
+
+/// Writes the response frame of a request.
+/// @param session Session the response belongs to.
+/// @param request Request being answered.
+/// @param payload Payload of the response.
+/// @param size Size of the payload.
+/// @return 0 if the response was written successfully, 1 otherwise.
+int session_respond(struct Session* session, const struct Request* request, const void* payload, size_t size);
+
+/// Writes a frame pushed by the server, which answers no request of its own.
+/// @param session Session the frame is pushed to.
+/// @param op Op code of the frame.
+/// @param request_id Id of the request the frame follows up on.
+/// @param payload Payload of the frame.
+/// @param size Size of the payload.
+/// @return 0 if the frame was written successfully, 1 otherwise.
+int session_push(struct Session* session, char op, unsigned int request_id, const void* payload, size_t size);
+
+/// Frees the scratch buffers of a session, which keeps working and grows them again on demand.
+/// @param session Session to trim.
+void session_release_buffers(struct Session* session);
+
+#endif  // SERVER_SESSION_H
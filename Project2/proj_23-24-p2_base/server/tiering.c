@@ -0,0 +1,207 @@
+#include "tiering.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TIERING_MAX_PERIOD_S 60  // Longest wait between sweeps, however long events take to go cold
+
+static int spill_fd = -1;
+static unsigned int cold_after = 0;
+static off_t spill_end = 0;  // Only moved by the tiering worker, the one thread that spills
+static size_t page_size = 0;  // Granularity of the private copies of template grids, 0 while tiering is off
+
+// Bytes of grids in memory, each shared block counted once, and in the spill file
+static atomic_size_t resident_bytes = 0;
+static atomic_size_t spilled_bytes = 0;
+
+/// Gets the size of the grid of an event.
+static size_t grid_size(const struct Event *event) { return sizeof(unsigned int) * event->rows * event->cols; }
+
+/// Writes a whole buffer at an offset of the spill file.
+/// @return 0 if everything was written, 1 otherwise.
+static int write_spill(const void *data, size_t size, off_t offset) {
+  const char *bytes = data;
+  while (size > 0) {
+    ssize_t written = pwrite(spill_fd, bytes, size, offset);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return 1;
+    }
+    bytes += written;
+    size -= (size_t)written;
+    offset += written;
+  }
+  return 0;
+}
+
+/// Reads a whole buffer from an offset of the spill file.
+/// @return 0 if everything was read, 1 otherwise.
+static int read_spill(void *data, size_t size, off_t offset) {
+  char *bytes = data;
+  while (size > 0) {
+    ssize_t got = pread(spill_fd, bytes, size, offset);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return 1;
+    }
+    bytes += got;
+    size -= (size_t)got;
+    offset += got;
+  }
+  return 0;
+}
+
+int tiering_init(unsigned int cold_after_s, const char *spill_path) {
+  if (spill_path != NULL) {
+    spill_fd = open(spill_path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  } else {
+    // The file is unlinked right away, so it goes away with the server
+    char path[] = "/tmp/ems-spill-XXXXXX";
+    spill_fd = mkstemp(path);
+    if (spill_fd != -1) {
+      unlink(path);
+    }
+  }
+
+  if (spill_fd == -1) {
+    fprintf(stderr, "Failed to open the spill file.\n");
+    return 1;
+  }
+
+  cold_after = cold_after_s;
+  page_size = (size_t)sysconf(_SC_PAGESIZE);
+  return 0;
+}
+
+time_t tiering_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec;
+}
+
+unsigned int tiering_period(void) {
+  if (spill_fd == -1) {
+    return 0;
+  }
+  unsigned int period = cold_after / 2;
+  return period < 1 ? 1 : period > TIERING_MAX_PERIOD_S ? TIERING_MAX_PERIOD_S : period;
+}
+
+void tiering_track(struct Event *event) {
+  event->spill_offset = -1;
+  event->last_access = tiering_now();
+  if (event->arena == NULL && event->mapped_size == 0) {
+    atomic_fetch_add(&resident_bytes, grid_size(event));
+  }
+}
+
+void tiering_track_shared(size_t size) { atomic_fetch_add(&resident_bytes, size); }
+
+int tiering_track_mapping(struct Event *event) {
+  if (page_size == 0) {
+    return 0;
+  }
+  size_t num_pages = (event->mapped_size + page_size - 1) / page_size;
+  event->copied = calloc((num_pages + 7) / 8, 1);
+  return event->copied == NULL;
+}
+
+void tiering_write(struct Event *event, size_t seat) {
+  if (event->copied == NULL) {
+    return;
+  }
+  size_t page = seat * sizeof(unsigned int) / page_size;
+  unsigned char bit = (unsigned char)(1u << (page % 8));
+  if ((event->copied[page / 8] & bit) == 0) {
+    event->copied[page / 8] |= bit;
+    atomic_fetch_add(&resident_bytes, page_size);
+  }
+}
+
+int tiering_load(struct Event *event) {
+  event->last_access = tiering_now();
+  if (event->data != NULL) {
+    return 0;
+  }
+
+  // A grid that was never reserved is all zeros, so it was never written
+  size_t size = grid_size(event);
+  unsigned int *data = event->reservations == 0 ? calloc(size, 1) : malloc(size);
+  if (data == NULL || (event->reservations > 0 && read_spill(data, size, event->spill_offset) != 0)) {
+    fprintf(stderr, "Failed to read event %u back from the spill file\n", event->id);
+    free(data);
+    return 1;
+  }
+
+  // The grid comes back on its own, whatever it was a part of before it was spilled
+  event->data = data;
+  atomic_fetch_add(&resident_bytes, size);
+  atomic_fetch_sub(&spilled_bytes, size);
+  return 0;
+}
+
+int tiering_spill_if_cold(struct Event *event, time_t now) {
+  size_t size = grid_size(event);
+  if (spill_fd == -1 || event->data == NULL || size == 0 || now - event->last_access < (time_t)cold_after) {
+    return 0;
+  }
+
+  // Each event keeps the place it got the first time, so the file only grows with events never spilled before
+  if (event->reservations > 0) {
+    off_t offset = event->spill_offset >= 0 ? event->spill_offset : spill_end;
+    if (write_spill(event->data, size, offset) != 0) {
+      fprintf(stderr, "Failed to write event %u to the spill file\n", event->id);
+      return 0;
+    }
+    if (event->spill_offset < 0) {
+      event->spill_offset = offset;
+      spill_end += (off_t)size;
+    }
+  }
+
+  size_t released = size;
+  if (event->arena != NULL) {
+    // Grids of a bulk creation are freed together, once the last of them is spilled
+    released = 0;
+    if (--event->arena->users == 0) {
+      released = event->arena->size;
+      free(event->arena->data);
+      free(event->arena);
+    }
+    event->arena = NULL;
+  } else if (event->mapped_size > 0) {
+    // Only the pages written were the event's own, the rest stay with the template
+    released = 0;
+    for (size_t page = 0; event->copied != NULL && page * page_size < event->mapped_size; page++) {
+      if ((event->copied[page / 8] & (1u << (page % 8))) != 0) {
+        released += page_size;
+      }
+    }
+    munmap(event->data, event->mapped_size);
+    free(event->copied);
+    event->copied = NULL;
+    event->mapped_size = 0;
+  } else {
+    free(event->data);
+  }
+  event->data = NULL;
+
+  atomic_fetch_sub(&resident_bytes, released);
+  atomic_fetch_add(&spilled_bytes, size);
+  return 1;
+}
+
+void tiering_usage(size_t *resident, size_t *spilled) {
+  *resident = atomic_load(&resident_bytes);
+  *spilled = atomic_load(&spilled_bytes);
+}
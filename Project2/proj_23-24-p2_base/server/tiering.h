@@ -0,0 +1,62 @@
+#ifndef SERVER_TIERING_H
+#define SERVER_TIERING_H
+
+#include <stddef.h>
+
+#include "eventlist.h"
+
+/// Turns on tiering, so the grids of events left untouched for a while are moved to a spill file.
+/// @param cold_after_s Seconds an event must go untouched before its grid is spilled.
+/// @param spill_path Path of the spill file, NULL for an unnamed temporary file.
+/// @return 0 if tiering was turned on, 1 otherwise.
+int tiering_init(unsigned int cold_after_s, const char *spill_path);
+
+/// Starts tracking a new event, whose grid is resident.
+/// @note Must be called before the event is published. Grids in an arena or mapped from a template are not counted
+///       here, see tiering_track_shared and tiering_write.
+/// @param event Event to track.
+void tiering_track(struct Event *event);
+
+/// Counts a block of memory holding the grids of several events, such as an arena or a template, once.
+/// @note Must be called before the events are published.
+/// @param size Bytes of the block.
+void tiering_track_shared(size_t size);
+
+/// Starts counting the pages of a grid mapped from a template as writes copy them.
+/// @note Does nothing while tiering is off.
+/// @param event Event whose grid was just mapped.
+/// @return 0 if the pages are counted or tiering is off, 1 if there was no memory to count them.
+int tiering_track_mapping(struct Event *event);
+
+/// Counts the page of a seat as resident once it is first written, which makes a private copy of a template grid.
+/// @note The event mutex must be held. Does nothing for grids not mapped from a template.
+/// @param event Event whose seat is written.
+/// @param seat Index of the seat in the grid.
+void tiering_write(struct Event *event, size_t seat);
+
+/// Marks an event as used, reading its grid back from the spill file if it was spilled.
+/// @note The event mutex must be held.
+/// @param event Event about to be read or written.
+/// @return 0 if the grid is resident, 1 if it could not be read back.
+int tiering_load(struct Event *event);
+
+/// Moves the grid of an event to the spill file if it went untouched for long enough.
+/// @note The event mutex must be held. Only the tiering worker spills, which keeps the spill file append-only.
+/// @param event Event to check.
+/// @param now Current monotonic time in seconds.
+/// @return 1 if the grid was spilled, 0 otherwise.
+int tiering_spill_if_cold(struct Event *event, time_t now);
+
+/// Gets the current monotonic time in seconds, the clock of Event::last_access.
+time_t tiering_now(void);
+
+/// Gets how long the tiering worker waits between sweeps.
+/// @return Seconds between sweeps, 0 if tiering is off.
+unsigned int tiering_period(void);
+
+/// Gets the memory taken by the grids of every event.
+/// @param resident Pointer to the variable to store the bytes of grids in memory in, counting shared blocks once.
+/// @param spilled Pointer to the variable to store the bytes of grids spilled in, at their full size.
+void tiering_usage(size_t *resident, size_t *spilled);
+
+#endif  // SERVER_TIERING_H